@@ -0,0 +1,230 @@
+// BatchSweep.cpp
+#include "BatchSweep.h"
+#include "Globals.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+// CPU time of the calling thread; wall time would count time the OS gave to other workers
+static double threadCpuMs() {
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) return 0.0;
+    ULARGE_INTEGER k, u;
+    k.LowPart = kernel.dwLowDateTime;
+    k.HighPart = kernel.dwHighDateTime;
+    u.LowPart = user.dwLowDateTime;
+    u.HighPart = user.dwHighDateTime;
+    return (k.QuadPart + u.QuadPart) / 10000.0;
+#else
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+#endif
+}
+
+// Per axis (and seeds); the grid multiplies them, so a typo in a range should fail, not run for days
+static const uint64_t kMaxAxisValues = 100000;
+// Whole sweep, grid and explicit runs; every run is a full simulation
+static const uint64_t kMaxRuns = 1000000;
+
+static bool parseAxis(std::istringstream& line, std::vector<float>& values) {
+    std::string first;
+    if (!(line >> first)) return false;
+    values.clear();
+    if (first == "range") {
+        float from, to;
+        int count;
+        if (!(line >> from >> to >> count) || count < 1 || static_cast<uint64_t>(count) > kMaxAxisValues) return false;
+        for (int i = 0; i < count; ++i)
+            values.push_back(count == 1 ? from : from + (to - from) * i / (count - 1));
+        return true;
+    }
+    values.push_back(std::stof(first));
+    float value;
+    while (line >> value) values.push_back(value);
+    return true;
+}
+
+bool SweepSpec::load(const std::string& path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        logger.addLog(LogLevel::Error, "Failed to open sweep spec: " + path);
+        return false;
+    }
+    std::string text;
+    int lineNumber = 0;
+    bool sawGridAxis = false;
+    while (std::getline(file, text)) {
+        ++lineNumber;
+        text = text.substr(0, text.find('#'));
+        std::istringstream line(text);
+        std::string key;
+        if (!(line >> key)) continue;
+        bool ok = true;
+        try {
+            if (key == "fallHeight") ok = sawGridAxis = parseAxis(line, fallHeights);
+            else if (key == "impactAngle") ok = sawGridAxis = parseAxis(line, impactAngles);
+            else if (key == "areaThreshold") ok = sawGridAxis = parseAxis(line, areaThresholds);
+            else if (key == "seeds") {
+                uint32_t first, last;
+                ok = static_cast<bool>(line >> first >> last) && first <= last;
+                if (ok && static_cast<uint64_t>(last) - first + 1 > kMaxAxisValues) {
+                    logger.addLog(LogLevel::Error, path + ":" + std::to_string(lineNumber) + ": more than "
+                        + std::to_string(kMaxAxisValues) + " seeds");
+                    ok = false;
+                }
+                seeds.clear();
+                // 64-bit counter: last may be UINT32_MAX
+                for (uint64_t s = first; ok && s <= last; ++s) seeds.push_back(static_cast<uint32_t>(s));
+                sawGridAxis = sawGridAxis || ok;
+            }
+            else if (key == "run") {
+                SimulationParams params;
+                ok = static_cast<bool>(line >> params.fallHeight >> params.impactAngle >> params.seed);
+                if (ok) explicitRuns.push_back(params);
+            }
+            else if (key == "dt") ok = static_cast<bool>(line >> dt) && dt > 0.0f;
+            else if (key == "maxTime") ok = static_cast<bool>(line >> maxTime) && maxTime > 0.0f;
+            else ok = false;
+        }
+        catch (const std::exception&) {
+            ok = false;
+        }
+        if (!ok) {
+            logger.addLog(LogLevel::Error, path + ":" + std::to_string(lineNumber) + ": bad sweep directive '" + key + "'");
+            return false;
+        }
+    }
+    // A spec with only explicit runs should not also run the default grid point
+    gridEnabled = sawGridAxis || explicitRuns.empty();
+    // Checked factor by factor so the product cannot overflow before it is compared
+    uint64_t runs = 1;
+    bool tooMany = false;
+    if (gridEnabled) {
+        const size_t factors[] = { fallHeights.size(), impactAngles.size(), areaThresholds.size(), seeds.size() };
+        for (size_t factor : factors) {
+            if (factor != 0 && runs > kMaxRuns / factor) tooMany = true;
+            else runs *= factor;
+        }
+    }
+    else {
+        runs = 0;
+    }
+    if (tooMany || runs + explicitRuns.size() > kMaxRuns) {
+        logger.addLog(LogLevel::Error, path + ": sweep has more than " + std::to_string(kMaxRuns) + " runs ("
+            + std::to_string(fallHeights.size()) + " fallHeight x " + std::to_string(impactAngles.size()) + " impactAngle x "
+            + std::to_string(areaThresholds.size()) + " areaThreshold x " + std::to_string(seeds.size()) + " seeds + "
+            + std::to_string(explicitRuns.size()) + " explicit)");
+        return false;
+    }
+    return true;
+}
+
+std::vector<SimulationParams> SweepSpec::expand() const {
+    std::vector<SimulationParams> runs;
+    if (gridEnabled) {
+        runs.reserve(fallHeights.size() * impactAngles.size() * areaThresholds.size() * seeds.size() + explicitRuns.size());
+        for (float height : fallHeights)
+            for (float angle : impactAngles)
+                for (float threshold : areaThresholds)
+                    for (uint32_t seed : seeds) {
+                        SimulationParams params;
+                        params.fallHeight = height;
+                        params.impactAngle = angle;
+                        params.areaThreshold = threshold;
+                        params.seed = seed;
+                        runs.push_back(params);
+                    }
+    }
+    for (const auto& params : explicitRuns) {
+        runs.push_back(params);
+        runs.back().areaThreshold = areaThresholds.front();
+    }
+    return runs;
+}
+
+static void runOne(SimulationCore& core, const SimulationParams& params, float dt, float maxTime, SweepResult& result) {
+    double cpuStart = threadCpuMs();
+    core.reset(params);
+    while (core.getState() == SimulationCore::State::FALLING && core.getSimulationTime() < maxTime)
+        core.update(dt);
+    result.params = params;
+    result.impactTime = core.getSimulationTime();
+    while (core.getState() == SimulationCore::State::SHATTERED && core.getSimulationTime() < maxTime)
+        core.update(dt);
+    result.settled = core.getState() == SimulationCore::State::SIMULATION_DONE;
+    result.settleTime = core.getSimulationTime() - result.impactTime;
+    const std::vector<FragmentSim>& fragments = core.getFragments();
+    result.fragmentCount = fragments.size();
+    glm::vec3 impact = core.getGlassPosition();
+    double sum = 0.0;
+    float spread = 0.0f;
+    for (const auto& frag : fragments) {
+        float radius = std::sqrt((frag.position.x - impact.x) * (frag.position.x - impact.x)
+            + (frag.position.z - impact.z) * (frag.position.z - impact.z));
+        spread = std::max(spread, radius);
+        sum += radius;
+    }
+    result.spreadRadius = spread;
+    result.meanRadius = fragments.empty() ? 0.0f : static_cast<float>(sum / fragments.size());
+    result.cpuMs = threadCpuMs() - cpuStart;
+}
+
+std::vector<SweepResult> runSweep(const SweepSpec& spec, const std::vector<Mesh>& sourceMeshes, unsigned threadCount) {
+    TRACE_SCOPE("runSweep");
+    std::vector<SimulationParams> runs = spec.expand();
+    std::vector<SweepResult> results(runs.size());
+    if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+    threadCount = static_cast<unsigned>(std::min<size_t>(threadCount, std::max<size_t>(runs.size(), 1)));
+    logger.addLog("Sweeping " + std::to_string(runs.size()) + " runs on " + std::to_string(threadCount) + " threads.");
+
+    // Runs vary wildly in cost (fragment count grows 4x per halving of areaThreshold), so workers
+    // pull the next index from a shared counter instead of taking fixed slices
+    FractureTemplateCache templates(sourceMeshes);
+    std::atomic<size_t> next(0);
+    std::atomic<size_t> done(0);
+    auto worker = [&]() {
+        // One core per worker, reset for each run so the fragment vector keeps its capacity
+        SimulationCore core(templates);
+        for (size_t i = next++; i < runs.size(); i = next++) {
+            runOne(core, runs[i], spec.dt, spec.maxTime, results[i]);
+            size_t finished = ++done;
+            if (finished % 100 == 0 || finished == runs.size())
+                logger.addLog(std::to_string(finished) + " / " + std::to_string(runs.size()) + " runs done.");
+        }
+    };
+    std::vector<std::thread> threads;
+    for (unsigned t = 1; t < threadCount; ++t) threads.emplace_back(worker);
+    worker();
+    for (auto& thread : threads) thread.join();
+    return results;
+}
+
+bool writeSweepCsv(const std::string& path, const std::vector<SweepResult>& results) {
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) {
+        logger.addLog(LogLevel::Error, "Failed to write sweep results: " + path);
+        return false;
+    }
+    fprintf(file, "fallHeight,impactAngle,areaThreshold,seed,fragments,impactTime,settleTime,settled,spreadRadius,meanRadius,cpuMs\n");
+    for (const auto& r : results) {
+        fprintf(file, "%g,%g,%g,%u,%zu,%.4f,%.4f,%d,%.4f,%.4f,%.3f\n", r.params.fallHeight, r.params.impactAngle,
+            r.params.areaThreshold, r.params.seed, r.fragmentCount, r.impactTime, r.settleTime, r.settled ? 1 : 0,
+            r.spreadRadius, r.meanRadius, r.cpuMs);
+    }
+    bool ok = !ferror(file);
+    fclose(file);
+    return ok;
+}
@@ -0,0 +1,44 @@
+// BatchSweep.h
+#pragma once
+#include "SimulationCore.h"
+#include <string>
+#include <vector>
+
+struct SweepResult {
+    SimulationParams params;
+    size_t fragmentCount = 0;
+    float impactTime = 0.0f;    // simulation time at which the glass hit the floor
+    float settleTime = 0.0f;    // impact until every fragment stopped, or maxTime if it never did
+    bool settled = false;
+    float spreadRadius = 0.0f;  // furthest fragment from the impact point, on the floor plane
+    float meanRadius = 0.0f;
+    double cpuMs = 0.0;         // thread CPU time spent in the run
+};
+
+// A parameter sweep read from a plain text spec, one directive per line ('#' starts a comment):
+//   fallHeight 5 10 20         list of values
+//   impactAngle range 0 90 7   7 evenly spaced values from 0 to 90
+//   areaThreshold 0.005
+//   seeds 1 64                 seeds 1..64 for every grid point
+//   run 12 30 7                explicit (fallHeight impactAngle seed) run at the first areaThreshold
+//   dt 0.008333                fixed step every run is simulated with
+//   maxTime 30                 give up on settling after this much simulated time
+// The grid is the cross product of the axis values and seeds; an axis or the seed range may hold
+// at most 100000 values and the whole sweep at most 1000000 runs.
+struct SweepSpec {
+    std::vector<float> fallHeights = { 10.0f };
+    std::vector<float> impactAngles = { 45.0f };
+    std::vector<float> areaThresholds = { 0.005f };
+    std::vector<uint32_t> seeds = { 1 };
+    std::vector<SimulationParams> explicitRuns;
+    bool gridEnabled = true;
+    float dt = 1.0f / 120.0f;
+    float maxTime = 30.0f;
+    bool load(const std::string& path);
+    std::vector<SimulationParams> expand() const;
+};
+
+// Runs every configuration on its own SimulationCore, spread over all hardware threads.
+// Results come back in spec order regardless of which worker finished first.
+std::vector<SweepResult> runSweep(const SweepSpec& spec, const std::vector<Mesh>& sourceMeshes, unsigned threadCount = 0);
+bool writeSweepCsv(const std::string& path, const std::vector<SweepResult>& results);
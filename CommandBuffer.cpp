@@ -0,0 +1,317 @@
+// CommandBuffer.cpp
+#include "CommandBuffer.h"
+#include "GlState.h"
+#include "Globals.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+CommandBuffer::CommandBuffer() : lastDraw(kNoDraw), sorted(true) {}
+
+void CommandBuffer::clear() {
+    commands.clear();
+    payload.clear();
+    lastDraw = kNoDraw;
+    sorted = true;
+}
+
+// pass 63..56 | draw 55 | order 54..40 | program 39..20 | vertex array 19..0
+uint64_t CommandBuffer::makeKey(RenderPass pass, bool draw, uint16_t order, GLuint program, GLuint vertexArray) {
+    return (static_cast<uint64_t>(pass) << 56) | (static_cast<uint64_t>(draw ? 1 : 0) << 55) |
+        (static_cast<uint64_t>(order & 0x7fff) << 40) | (static_cast<uint64_t>(program & 0xfffff) << 20) |
+        static_cast<uint64_t>(vertexArray & 0xfffff);
+}
+
+// Payloads are copied in and out with memcpy, so the byte vector needs no alignment of its own
+template <typename T> uint32_t CommandBuffer::write(const T& value) {
+    uint32_t offset = static_cast<uint32_t>(payload.size());
+    payload.resize(offset + (sizeof(T) + kAlignment - 1) / kAlignment * kAlignment);
+    memcpy(&payload[offset], &value, sizeof(T));
+    return offset;
+}
+
+template <typename T> T CommandBuffer::read(uint32_t offset) const {
+    T value;
+    memcpy(&value, &payload[offset], sizeof(T));
+    return value;
+}
+
+void CommandBuffer::upload(RenderPass pass, GLenum target, GLuint buffer, const void* data, size_t size,
+    size_t capacity, GLenum usage) {
+    UploadPayload upload;
+    upload.data = data;
+    upload.size = size;
+    upload.capacity = std::max(size, capacity);
+    upload.target = target;
+    upload.buffer = buffer;
+    upload.usage = usage;
+    Command command;
+    command.key = makeKey(pass, false, 0, 0, buffer);
+    command.offset = write(upload);
+    command.type = Type::Upload;
+    commands.push_back(command);
+    lastDraw = kNoDraw;
+    sorted = false;
+}
+
+void CommandBuffer::draw(RenderPass pass, const DrawDesc& desc) {
+    DrawPayload draw;
+    draw.desc = desc;
+    draw.uniformCount = 0;
+    Command command;
+    command.key = makeKey(pass, true, desc.order, desc.program, desc.vertexArray);
+    command.offset = write(draw);
+    command.type = Type::Draw;
+    commands.push_back(command);
+    lastDraw = command.offset;
+    sorted = false;
+}
+
+void CommandBuffer::addUniform(const UniformPayload& value) {
+    if (lastDraw == kNoDraw) {
+        logger.addLog(LogLevel::Error, std::string("Command buffer: uniform ") + value.name + " has no draw.");
+        return;
+    }
+    write(value);
+    DrawPayload draw = read<DrawPayload>(lastDraw);
+    draw.uniformCount++;
+    memcpy(&payload[lastDraw], &draw, sizeof(draw));
+}
+
+void CommandBuffer::uniform(const char* name, const glm::mat4& value) {
+    UniformPayload entry = {};
+    entry.name = name;
+    entry.matrix = true;
+    memcpy(entry.matrixValue, &value[0][0], sizeof(entry.matrixValue));
+    addUniform(entry);
+}
+
+void CommandBuffer::uniform(const char* name, int value) {
+    UniformPayload entry = {};
+    entry.name = name;
+    entry.integer = value;
+    addUniform(entry);
+}
+
+void CommandBuffer::append(const CommandBuffer& other) {
+    uint32_t base = static_cast<uint32_t>(payload.size());
+    payload.insert(payload.end(), other.payload.begin(), other.payload.end());
+    for (Command command : other.commands) {
+        command.offset += base;
+        commands.push_back(command);
+    }
+    lastDraw = kNoDraw;
+    sorted = sorted && other.commands.empty();
+}
+
+void CommandBuffer::sort() {
+    if (sorted) return;
+    TRACE_SCOPE("CommandBuffer::sort");
+    std::stable_sort(commands.begin(), commands.end(),
+        [](const Command& a, const Command& b) { return a.key < b.key; });
+    sorted = true;
+}
+
+void CommandBuffer::submit(RenderPass pass) const {
+    auto first = commands.begin();
+    auto last = commands.end();
+    if (sorted) {
+        uint64_t passKey = static_cast<uint64_t>(pass) << 56;
+        first = std::lower_bound(commands.begin(), commands.end(), passKey,
+            [](const Command& command, uint64_t key) { return command.key < key; });
+        last = std::lower_bound(first, commands.end(), passKey + (1ull << 56),
+            [](const Command& command, uint64_t key) { return command.key < key; });
+    }
+    for (auto it = first; it != last; ++it) {
+        if (static_cast<RenderPass>(it->key >> 56) != pass) continue;
+        if (it->type == Type::Upload) {
+            UploadPayload upload = read<UploadPayload>(it->offset);
+            glState.bindBuffer(upload.target, upload.buffer);
+            glBufferData(upload.target, static_cast<GLsizeiptr>(upload.capacity), nullptr, upload.usage);
+            glBufferSubData(upload.target, 0, static_cast<GLsizeiptr>(upload.size), upload.data);
+            continue;
+        }
+        DrawPayload draw = read<DrawPayload>(it->offset);
+        const DrawDesc& desc = draw.desc;
+        glState.useProgram(desc.program);
+        glState.setEnabled(GL_DEPTH_TEST, desc.depthTest);
+        for (int unit = 0; unit < 2; ++unit) {
+            if (desc.textureTargets[unit] == GL_NONE) continue;
+            glState.activeTexture(GL_TEXTURE0 + unit);
+            glState.bindTexture(desc.textureTargets[unit], desc.textures[unit]);
+        }
+        uint32_t offset = it->offset + static_cast<uint32_t>((sizeof(DrawPayload) + kAlignment - 1) / kAlignment * kAlignment);
+        for (uint32_t i = 0; i < draw.uniformCount; ++i) {
+            UniformPayload entry = read<UniformPayload>(offset);
+            offset += static_cast<uint32_t>((sizeof(UniformPayload) + kAlignment - 1) / kAlignment * kAlignment);
+            GLint location = glGetUniformLocation(desc.program, entry.name);
+            if (entry.matrix) glUniformMatrix4fv(location, 1, GL_FALSE, entry.matrixValue);
+            else glUniform1i(location, entry.integer);
+        }
+        glState.bindVertexArray(desc.vertexArray);
+        if (desc.indexType != GL_NONE) {
+            if (desc.instanceCount > 0) glDrawElementsInstanced(desc.mode, desc.count, desc.indexType, nullptr, desc.instanceCount);
+            else glDrawElements(desc.mode, desc.count, desc.indexType, nullptr);
+        }
+        else {
+            if (desc.instanceCount > 0) glDrawArraysInstanced(desc.mode, 0, desc.count, desc.instanceCount);
+            else glDrawArrays(desc.mode, 0, desc.count);
+        }
+    }
+}
+
+static const char* passName(RenderPass pass) {
+    switch (pass) {
+    case RenderPass::Sky: return "sky";
+    case RenderPass::Opaque: return "opaque";
+    case RenderPass::Glass: return "glass";
+    case RenderPass::Particles: return "particles";
+    default: return "?";
+    }
+}
+
+static std::string enumName(GLenum value) {
+    switch (value) {
+    case GL_POINTS: return "POINTS";
+    case GL_TRIANGLES: return "TRIANGLES";
+    case GL_TRIANGLE_STRIP: return "TRIANGLE_STRIP";
+    case GL_TRIANGLE_FAN: return "TRIANGLE_FAN";
+    case GL_ARRAY_BUFFER: return "ARRAY_BUFFER";
+    case GL_TEXTURE_BUFFER: return "TEXTURE_BUFFER";
+    case GL_TEXTURE_2D: return "TEXTURE_2D";
+    case GL_UNSIGNED_INT: return "UNSIGNED_INT";
+    case GL_UNSIGNED_SHORT: return "UNSIGNED_SHORT";
+    case GL_STATIC_DRAW: return "STATIC_DRAW";
+    case GL_STREAM_DRAW: return "STREAM_DRAW";
+    case GL_DYNAMIC_DRAW: return "DYNAMIC_DRAW";
+    default: {
+        char hex[16];
+        snprintf(hex, sizeof(hex), "0x%04x", value);
+        return hex;
+    }
+    }
+}
+
+std::string CommandBuffer::dump() const {
+    std::string out;
+    char line[256];
+    for (const Command& command : commands) {
+        RenderPass pass = static_cast<RenderPass>(command.key >> 56);
+        snprintf(line, sizeof(line), "%016llx %-9s ", static_cast<unsigned long long>(command.key), passName(pass));
+        out += line;
+        if (command.type == Type::Upload) {
+            UploadPayload upload = read<UploadPayload>(command.offset);
+            snprintf(line, sizeof(line), "upload %s buffer=%u bytes=%llu capacity=%llu %s\n",
+                enumName(upload.target).c_str(), upload.buffer, static_cast<unsigned long long>(upload.size),
+                static_cast<unsigned long long>(upload.capacity), enumName(upload.usage).c_str());
+            out += line;
+            continue;
+        }
+        DrawPayload draw = read<DrawPayload>(command.offset);
+        const DrawDesc& desc = draw.desc;
+        snprintf(line, sizeof(line), "draw program=%u vao=%u %s count=%d instances=%d%s%s%s", desc.program,
+            desc.vertexArray, enumName(desc.mode).c_str(), desc.count, desc.instanceCount,
+            desc.indexType != GL_NONE ? " indexed=" : "", desc.indexType != GL_NONE ? enumName(desc.indexType).c_str() : "",
+            desc.depthTest ? "" : " no-depth-test");
+        out += line;
+        for (int unit = 0; unit < 2; ++unit) {
+            if (desc.textureTargets[unit] == GL_NONE) continue;
+            snprintf(line, sizeof(line), " tex%d=%s:%u", unit, enumName(desc.textureTargets[unit]).c_str(), desc.textures[unit]);
+            out += line;
+        }
+        uint32_t offset = command.offset + static_cast<uint32_t>((sizeof(DrawPayload) + kAlignment - 1) / kAlignment * kAlignment);
+        for (uint32_t i = 0; i < draw.uniformCount; ++i) {
+            UniformPayload entry = read<UniformPayload>(offset);
+            offset += static_cast<uint32_t>((sizeof(UniformPayload) + kAlignment - 1) / kAlignment * kAlignment);
+            if (entry.matrix) snprintf(line, sizeof(line), " %s=mat4", entry.name);
+            else snprintf(line, sizeof(line), " %s=%d", entry.name, entry.integer);
+            out += line;
+        }
+        out += '\n';
+    }
+    return out;
+}
+
+bool CommandBuffer::dump(const std::string& path) const {
+    std::ofstream file(path);
+    if (!file) {
+        logger.addLog(LogLevel::Error, "Cannot write command dump " + path);
+        return false;
+    }
+    file << dump();
+    logger.addLog("Dumped " + std::to_string(commands.size()) + " commands to " + path);
+    return true;
+}
+
+bool CommandBuffer::selfCheck() {
+    static const float instances[4] = {};
+    CommandBuffer scene, particles;
+    DrawDesc draw;
+    draw.program = 9;
+    draw.vertexArray = 5;
+    draw.count = 36;
+    draw.instanceCount = 2;
+    draw.indexType = GL_UNSIGNED_INT;
+    draw.order = 1;
+    scene.draw(RenderPass::Glass, draw);
+    scene.uniform("view", glm::mat4(1.0f));
+    draw.program = 4;
+    draw.vertexArray = 6;
+    draw.count = 3;
+    draw.indexType = GL_NONE;
+    draw.textureTargets[0] = GL_TEXTURE_BUFFER;
+    draw.textures[0] = 3;
+    draw.order = 2;     // after the first draw despite the lower program
+    scene.draw(RenderPass::Glass, draw);
+    scene.uniform("fragmentTriangles", 0);
+    // Recorded after the draws of its pass but has to come first
+    scene.upload(RenderPass::Glass, GL_ARRAY_BUFFER, 7, instances, sizeof(instances), 0, GL_STREAM_DRAW);
+    // Same order: sorted by program
+    DrawDesc opaque;
+    opaque.program = 8;
+    opaque.vertexArray = 2;
+    opaque.mode = GL_TRIANGLE_FAN;
+    opaque.count = 4;
+    scene.draw(RenderPass::Opaque, opaque);
+    scene.uniform("model", 11);
+    opaque.program = 3;
+    scene.draw(RenderPass::Opaque, opaque);
+    scene.uniform("model", 12);
+    // Recorded separately: its payload offsets have to be rebased by append()
+    DrawDesc sky;
+    sky.program = 1;
+    sky.vertexArray = 1;
+    sky.mode = GL_TRIANGLE_STRIP;
+    sky.count = 4;
+    sky.depthTest = false;
+    particles.upload(RenderPass::Particles, GL_ARRAY_BUFFER, 11, instances, sizeof(instances), 64, GL_STREAM_DRAW);
+    DrawDesc points;
+    points.program = 6;
+    points.vertexArray = 8;
+    points.count = 6;
+    points.instanceCount = 1;
+    particles.draw(RenderPass::Particles, points);
+    particles.uniform("projection", glm::mat4(1.0f));
+    particles.uniform("pointScale", 7);
+    particles.draw(RenderPass::Sky, sky);
+    particles.uniform("exposure", 5);
+    scene.append(particles);
+    scene.sort();
+    const std::string expected =
+        "0080000000100001 sky       draw program=1 vao=1 TRIANGLE_STRIP count=4 instances=0 no-depth-test exposure=5\n"
+        "0180000000300002 opaque    draw program=3 vao=2 TRIANGLE_FAN count=4 instances=0 model=12\n"
+        "0180000000800002 opaque    draw program=8 vao=2 TRIANGLE_FAN count=4 instances=0 model=11\n"
+        "0200000000000007 glass     upload ARRAY_BUFFER buffer=7 bytes=16 capacity=16 STREAM_DRAW\n"
+        "0280010000900005 glass     draw program=9 vao=5 TRIANGLES count=36 instances=2 indexed=UNSIGNED_INT view=mat4\n"
+        "0280020000400006 glass     draw program=4 vao=6 TRIANGLES count=3 instances=2 tex0=TEXTURE_BUFFER:3 fragmentTriangles=0\n"
+        "030000000000000b particles upload ARRAY_BUFFER buffer=11 bytes=16 capacity=64 STREAM_DRAW\n"
+        "0380000000600008 particles draw program=6 vao=8 TRIANGLES count=6 instances=1 projection=mat4 pointScale=7\n";
+    std::string actual = scene.dump();
+    if (actual != expected) {
+        logger.addLog(LogLevel::Error, "Command buffer check failed, expected:\n" + expected + "got:\n" + actual);
+        return false;
+    }
+    logger.addLog("Command buffer check passed (" + std::to_string(scene.getCommandCount()) + " commands).");
+    return true;
+}
@@ -0,0 +1,90 @@
+// CommandBuffer.h
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Parts of a frame, in submission order
+enum class RenderPass : uint8_t { Sky, Opaque, Glass, Particles, Count };
+
+// Buffer uploads and draws recorded without touching GL, so any thread can build one (one thread
+// per buffer) and a headless test can dump it. Each command is a 64-bit sort key plus a packed
+// payload; sort() orders by key, stably, and submit() replays one pass on the GL thread through
+// glState. Keys put a pass's uploads before its draws, then order by the draw's order field,
+// program and vertex array, so equal state ends up adjacent. Uploads point at the caller's data,
+// which has to stay unchanged until the pass is submitted.
+class CommandBuffer {
+public:
+    struct DrawDesc {
+        GLuint program = 0;
+        GLuint vertexArray = 0;
+        GLenum mode = GL_TRIANGLES;
+        GLsizei count = 0;
+        GLsizei instanceCount = 0;      // 0 for a non-instanced draw
+        GLenum indexType = GL_NONE;     // element draws: type of the bound index buffer
+        bool depthTest = true;
+        GLenum textureTargets[2] = { GL_NONE, GL_NONE };    // per unit, GL_NONE leaves it alone
+        GLuint textures[2] = { 0, 0 };
+        uint16_t order = 0;     // ahead of state in the key: keeps blending order where it matters
+    };
+    CommandBuffer();
+    void clear();
+    // Orphans buffer at capacity bytes (at least size), then fills the first size bytes from data
+    void upload(RenderPass pass, GLenum target, GLuint buffer, const void* data, size_t size, size_t capacity,
+        GLenum usage);
+    void draw(RenderPass pass, const DrawDesc& desc);
+    // Uniforms of the last draw; name must be a string literal or otherwise outlive the buffer
+    void uniform(const char* name, const glm::mat4& value);
+    void uniform(const char* name, int value);
+    // Copies other's commands in (buffers recorded on separate threads); sort again afterwards
+    void append(const CommandBuffer& other);
+    void sort();
+    // GL thread. Unsorted, the pass replays in record order
+    void submit(RenderPass pass) const;
+    size_t getCommandCount() const { return commands.size(); }
+    size_t getPayloadSize() const { return payload.size(); }
+    // One line per command, in current order
+    std::string dump() const;
+    bool dump(const std::string& path) const;
+    static uint64_t makeKey(RenderPass pass, bool draw, uint16_t order, GLuint program, GLuint vertexArray);
+    // Records two buffers of known commands, appends and sorts them and compares dump() with the
+    // expected text, logging any difference; needs no GL context
+    static bool selfCheck();
+private:
+    enum class Type : uint8_t { Upload, Draw };
+    struct Command {
+        uint64_t key;
+        uint32_t offset;    // into payload
+        Type type;
+    };
+    struct UploadPayload {
+        const void* data;
+        uint64_t size;
+        uint64_t capacity;
+        GLenum target;
+        GLuint buffer;
+        GLenum usage;
+    };
+    struct DrawPayload {
+        DrawDesc desc;
+        uint32_t uniformCount;  // UniformPayloads that follow
+    };
+    struct UniformPayload {
+        const char* name;
+        bool matrix;
+        int integer;
+        float matrixValue[16];
+    };
+    static constexpr size_t kAlignment = 8;
+    static constexpr uint32_t kNoDraw = ~0u;
+    std::vector<Command> commands;
+    std::vector<uint8_t> payload;
+    uint32_t lastDraw;      // payload offset of the draw uniforms attach to
+    bool sorted;
+    template <typename T> uint32_t write(const T& value);
+    template <typename T> T read(uint32_t offset) const;
+    void addUniform(const UniformPayload& value);
+};
@@ -0,0 +1,207 @@
+// Culling.cpp
+#include "Culling.h"
+#include "Globals.h"
+#include <algorithm>
+#include <cmath>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CULLING_SSE2 1
+#endif
+
+Frustum Frustum::fromMatrix(const glm::mat4& m) {
+    // Gribb/Hartmann: rows of the (column-major) matrix combined with the w row
+    glm::vec4 row[4];
+    for (int i = 0; i < 4; ++i) {
+        row[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+    }
+    Frustum frustum;
+    frustum.planes[0] = row[3] + row[0];
+    frustum.planes[1] = row[3] - row[0];
+    frustum.planes[2] = row[3] + row[1];
+    frustum.planes[3] = row[3] - row[1];
+    frustum.planes[4] = row[3] + row[2];
+    frustum.planes[5] = row[3] - row[2];
+    for (auto& plane : frustum.planes) {
+        float length = glm::length(glm::vec3(plane));
+        if (length > 0.0f) plane = plane * (1.0f / length);
+    }
+    return frustum;
+}
+
+bool Frustum::intersects(const BoundingSphere& sphere) const {
+    for (const auto& plane : planes) {
+        if (glm::dot(glm::vec3(plane), sphere.center) + plane.w < -sphere.radius) return false;
+    }
+    return true;
+}
+
+static float surfaceArea(const glm::vec3& lo, const glm::vec3& hi) {
+    glm::vec3 e = hi - lo;
+    return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+}
+
+SphereBvh::SphereBvh() : builtArea(0.0f), buildCount(0) {}
+
+void SphereBvh::build(const std::vector<BoundingSphere>& spheres) {
+    TRACE_SCOPE("SphereBvh::build");
+    size_t count = spheres.size();
+    order.resize(count);
+    buildCenters.resize(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        order[i] = i;
+        buildCenters[i] = spheres[i].center;
+    }
+    nodes.clear();
+    nodes.reserve(count / kLeafSize * 2 + 1);
+    Node root;
+    root.child = 0;
+    root.first = 0;
+    root.count = static_cast<uint32_t>(count);
+    nodes.push_back(root);
+    if (count > 0) buildNode(0);
+    loadLeafOrder(spheres);
+    builtArea = refitNodes();
+    buildCount++;
+}
+
+// Median split along the longest axis of the centroids
+void SphereBvh::buildNode(uint32_t index) {
+    uint32_t first = nodes[index].first;
+    uint32_t count = nodes[index].count;
+    if (count <= kLeafSize) return;
+    glm::vec3 lo = buildCenters[order[first]], hi = lo;
+    for (uint32_t i = first + 1; i < first + count; ++i) {
+        lo = glm::min(lo, buildCenters[order[i]]);
+        hi = glm::max(hi, buildCenters[order[i]]);
+    }
+    glm::vec3 extent = hi - lo;
+    int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+    // Left half rounded to whole leaves keeps the leaves full
+    uint32_t half = (count / 2 + kLeafSize - 1) / kLeafSize * kLeafSize;
+    std::nth_element(order.begin() + first, order.begin() + first + half, order.begin() + first + count,
+        [&](uint32_t a, uint32_t b) { return buildCenters[a][axis] < buildCenters[b][axis]; });
+    uint32_t child = static_cast<uint32_t>(nodes.size());
+    Node left, right;
+    left.child = right.child = 0;
+    left.first = first;
+    left.count = half;
+    right.first = first + half;
+    right.count = count - half;
+    nodes.push_back(left);
+    nodes.push_back(right);
+    nodes[index].child = child;
+    buildNode(child);
+    buildNode(child + 1);
+}
+
+void SphereBvh::loadLeafOrder(const std::vector<BoundingSphere>& spheres) {
+    size_t padded = order.size() + kLeafSize;
+    centerX.resize(padded);
+    centerY.resize(padded);
+    centerZ.resize(padded);
+    radius.resize(padded);
+    for (size_t i = 0; i < order.size(); ++i) {
+        const BoundingSphere& sphere = spheres[order[i]];
+        centerX[i] = sphere.center.x;
+        centerY[i] = sphere.center.y;
+        centerZ[i] = sphere.center.z;
+        radius[i] = sphere.radius;
+    }
+}
+
+// Children always follow their parent, so one backwards pass sees children first
+float SphereBvh::refitNodes() {
+    float area = 0.0f;
+    for (size_t n = nodes.size(); n-- > 0;) {
+        Node& node = nodes[n];
+        if (node.child) {
+            const Node& a = nodes[node.child];
+            const Node& b = nodes[node.child + 1];
+            node.lo = glm::min(a.lo, b.lo);
+            node.hi = glm::max(a.hi, b.hi);
+        }
+        else {
+            node.lo = glm::vec3(1e30f);
+            node.hi = glm::vec3(-1e30f);
+            for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+                glm::vec3 center(centerX[i], centerY[i], centerZ[i]);
+                node.lo = glm::min(node.lo, center - glm::vec3(radius[i]));
+                node.hi = glm::max(node.hi, center + glm::vec3(radius[i]));
+            }
+        }
+        if (node.count > 0) area += surfaceArea(node.lo, node.hi);
+    }
+    return area;
+}
+
+void SphereBvh::refit(const std::vector<BoundingSphere>& spheres) {
+    if (spheres.size() != order.size()) {
+        build(spheres);
+        return;
+    }
+    loadLeafOrder(spheres);
+    float area = refitNodes();
+    // Fragments scattering from one impact point make the old split planes useless quickly
+    if (area > builtArea * kRebuildRatio) build(spheres);
+}
+
+void SphereBvh::appendRange(const Node& node, std::vector<uint32_t>& visible) const {
+    visible.insert(visible.end(), order.begin() + node.first, order.begin() + node.first + node.count);
+}
+
+void SphereBvh::cullLeaf(const Frustum& frustum, const Node& node, std::vector<uint32_t>& visible) const {
+    uint32_t first = node.first;
+#ifdef CULLING_SSE2
+    __m128 x = _mm_loadu_ps(&centerX[first]);
+    __m128 y = _mm_loadu_ps(&centerY[first]);
+    __m128 z = _mm_loadu_ps(&centerZ[first]);
+    __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&radius[first]));
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (const auto& plane : frustum.planes) {
+        __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)), _mm_mul_ps(y, _mm_set1_ps(plane.y))),
+            _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(d, negRadius));
+    }
+    int mask = _mm_movemask_ps(inside) & ((1 << node.count) - 1);
+    for (uint32_t lane = 0; mask; ++lane, mask >>= 1) {
+        if (mask & 1) visible.push_back(order[first + lane]);
+    }
+#else
+    for (uint32_t i = first; i < first + node.count; ++i) {
+        BoundingSphere sphere = { glm::vec3(centerX[i], centerY[i], centerZ[i]), radius[i] };
+        if (frustum.intersects(sphere)) visible.push_back(order[i]);
+    }
+#endif
+}
+
+void SphereBvh::cull(const Frustum& frustum, std::vector<uint32_t>& visible) const {
+    if (order.empty()) return;
+    uint32_t stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const Node& node = nodes[stack[--top]];
+        // Box against each plane: the corner furthest along the normal decides outside, the
+        // nearest corner decides whether the box straddles the plane
+        bool outside = false;
+        bool straddles = false;
+        for (const auto& plane : frustum.planes) {
+            glm::vec3 farCorner(plane.x > 0.0f ? node.hi.x : node.lo.x, plane.y > 0.0f ? node.hi.y : node.lo.y,
+                plane.z > 0.0f ? node.hi.z : node.lo.z);
+            glm::vec3 nearCorner(plane.x > 0.0f ? node.lo.x : node.hi.x, plane.y > 0.0f ? node.lo.y : node.hi.y,
+                plane.z > 0.0f ? node.lo.z : node.hi.z);
+            if (glm::dot(glm::vec3(plane), farCorner) + plane.w < 0.0f) {
+                outside = true;
+                break;
+            }
+            if (glm::dot(glm::vec3(plane), nearCorner) + plane.w < 0.0f) straddles = true;
+        }
+        if (outside) continue;
+        if (!straddles) appendRange(node, visible);
+        else if (!node.child) cullLeaf(frustum, node, visible);
+        else {
+            stack[top++] = node.child;
+            stack[top++] = node.child + 1;
+        }
+    }
+}
@@ -0,0 +1,55 @@
+// Culling.h
+#pragma once
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+struct BoundingSphere {
+    glm::vec3 center;
+    float radius;
+};
+
+// Six planes (dot(plane.xyz, p) + plane.w >= 0 inside, normalized) of a view-projection matrix
+struct Frustum {
+    glm::vec4 planes[6];
+    static Frustum fromMatrix(const glm::mat4& viewProjection);
+    bool intersects(const BoundingSphere& sphere) const;
+};
+
+// Bounding volume hierarchy over spheres that move every step but are added or removed rarely.
+// refit() recomputes node bounds in place; once the tree has degraded (total node surface area
+// grown past kRebuildRatio times its value right after the last build) it rebuilds instead.
+// Leaves hold up to four spheres, stored SoA in leaf order, so each leaf is one SSE test.
+class SphereBvh {
+public:
+    SphereBvh();
+    void build(const std::vector<BoundingSphere>& spheres);
+    void refit(const std::vector<BoundingSphere>& spheres);
+    // Appends the index of every sphere that touches the frustum (order is leaf order)
+    void cull(const Frustum& frustum, std::vector<uint32_t>& visible) const;
+    size_t getItemCount() const { return order.size(); }
+    size_t getBuildCount() const { return buildCount; }
+    static constexpr uint32_t kLeafSize = 4;
+    static constexpr float kRebuildRatio = 2.0f;
+private:
+    // Every node covers the contiguous range [first, first + count) of order; internal nodes have
+    // their children at child and child + 1 (always after the parent, so refit runs backwards)
+    struct Node {
+        glm::vec3 lo;
+        uint32_t child;     // 0 for leaves, the root is never a child
+        glm::vec3 hi;
+        uint32_t first;
+        uint32_t count;
+    };
+    std::vector<Node> nodes;
+    std::vector<uint32_t> order;
+    std::vector<float> centerX, centerY, centerZ, radius;  // leaf order, padded for 4-wide loads
+    std::vector<glm::vec3> buildCenters;
+    float builtArea;
+    size_t buildCount;
+    void buildNode(uint32_t node);
+    void loadLeafOrder(const std::vector<BoundingSphere>& spheres);
+    float refitNodes();
+    void appendRange(const Node& node, std::vector<uint32_t>& visible) const;
+    void cullLeaf(const Frustum& frustum, const Node& node, std::vector<uint32_t>& visible) const;
+};
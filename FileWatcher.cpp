@@ -0,0 +1,125 @@
+// FileWatcher.cpp
+#include "FileWatcher.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+#include "Globals.h"
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+FileWatcher::FileWatcher() : running(false), handle(nullptr) {}
+
+FileWatcher::~FileWatcher() {
+    stop();
+}
+
+bool FileWatcher::start(const std::string& path) {
+    stop();
+    directory = path;
+#ifdef _WIN32
+    HANDLE notification = FindFirstChangeNotificationA(directory.c_str(), FALSE,
+        FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+    if (notification == INVALID_HANDLE_VALUE) {
+        logger.addLog(LogLevel::Error, "Cannot watch " + directory + " for changes.");
+        return false;
+    }
+    handle = notification;
+    scanWriteTimes(nullptr);
+#else
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0 || inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+        if (fd >= 0) close(fd);
+        logger.addLog(LogLevel::Error, "Cannot watch " + directory + " for changes.");
+        return false;
+    }
+    handle = reinterpret_cast<void*>(static_cast<intptr_t>(fd));
+#endif
+    running = true;
+    thread = std::thread(&FileWatcher::watchLoop, this);
+    logger.addLog("Watching " + directory + " for changes.");
+    return true;
+}
+
+void FileWatcher::stop() {
+    if (!running) return;
+    running = false;
+    if (thread.joinable()) thread.join();
+#ifdef _WIN32
+    FindCloseChangeNotification(static_cast<HANDLE>(handle));
+#else
+    close(static_cast<int>(reinterpret_cast<intptr_t>(handle)));
+#endif
+    handle = nullptr;
+}
+
+void FileWatcher::takeChanges(std::vector<std::pair<std::string, std::string>>& changes) {
+    changes.clear();
+    std::lock_guard<std::mutex> lock(changesMutex);
+    changes.swap(pending);
+}
+
+// Waits up to 50 ms (so stop() is noticed) and adds the names of touched files to dirty
+bool FileWatcher::waitForEvents(std::set<std::string>& dirty) {
+#ifdef _WIN32
+    if (WaitForSingleObject(static_cast<HANDLE>(handle), 50) != WAIT_OBJECT_0) return false;
+    FindNextChangeNotification(static_cast<HANDLE>(handle));
+    scanWriteTimes(&dirty);
+    return true;
+#else
+    pollfd descriptor = { static_cast<int>(reinterpret_cast<intptr_t>(handle)), POLLIN, 0 };
+    if (poll(&descriptor, 1, 50) <= 0) return false;
+    alignas(inotify_event) char buffer[4096];
+    ssize_t length;
+    while ((length = read(descriptor.fd, buffer, sizeof(buffer))) > 0) {
+        for (char* p = buffer; p < buffer + length;) {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+            if (event->len > 0 && !(event->mask & IN_ISDIR)) dirty.insert(event->name);
+            p += sizeof(inotify_event) + event->len;
+        }
+    }
+    return true;
+#endif
+}
+
+// Windows only tells that something in the directory changed: compare write times to find what
+void FileWatcher::scanWriteTimes(std::set<std::string>* dirty) {
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, error)) {
+        if (!entry.is_regular_file(error)) continue;
+        long long stamp = entry.last_write_time(error).time_since_epoch().count();
+        std::string name = entry.path().filename().string();
+        auto known = writeTimes.find(name);
+        if (known != writeTimes.end() && known->second == stamp) continue;
+        writeTimes[name] = stamp;
+        if (dirty) dirty->insert(name);
+    }
+}
+
+void FileWatcher::watchLoop() {
+    std::set<std::string> dirty;
+    auto lastEvent = std::chrono::steady_clock::now();
+    while (running) {
+        if (waitForEvents(dirty)) lastEvent = std::chrono::steady_clock::now();
+        if (dirty.empty() || std::chrono::steady_clock::now() - lastEvent < kSettle) continue;
+        std::vector<std::pair<std::string, std::string>> changes;
+        for (const std::string& name : dirty) {
+            std::string path = directory + "/" + name;
+            std::ifstream file(path);
+            if (!file.is_open()) continue;
+            std::stringstream stream;
+            stream << file.rdbuf();
+            // Caught between truncate and write; the write brings another event
+            if (stream.str().empty()) continue;
+            changes.emplace_back(path, stream.str());
+        }
+        dirty.clear();
+        std::lock_guard<std::mutex> lock(changesMutex);
+        for (auto& change : changes) pending.push_back(std::move(change));
+    }
+}
@@ -0,0 +1,38 @@
+// FileWatcher.h
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Watches one directory (not recursive) on a background thread: inotify on Linux, change
+// notifications plus a last-write-time scan on Windows. Editors touch a file several times per
+// save, so a file is only read once it has been quiet for kSettle; the contents are read on the
+// watcher thread and handed over whole.
+class FileWatcher {
+public:
+    FileWatcher();
+    ~FileWatcher();
+    bool start(const std::string& directory);
+    void stop();
+    bool isRunning() const { return running; }
+    // (directory/name, contents) of every file that changed since the last call
+    void takeChanges(std::vector<std::pair<std::string, std::string>>& changes);
+    static constexpr std::chrono::milliseconds kSettle{ 100 };
+private:
+    std::string directory;
+    std::thread thread;
+    std::atomic<bool> running;
+    std::mutex changesMutex;
+    std::vector<std::pair<std::string, std::string>> pending;
+    std::map<std::string, long long> writeTimes;    // Windows: last seen write time per file
+    void* handle;   // inotify descriptor (as intptr) or change notification handle
+    void watchLoop();
+    bool waitForEvents(std::set<std::string>& dirty);
+    void scanWriteTimes(std::set<std::string>* dirty);
+};
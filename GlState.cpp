@@ -0,0 +1,206 @@
+// GlState.cpp
+#include "GlState.h"
+#include "Globals.h"
+
+GlState glState;
+
+GlState::GlState() : issuedCalls(0), skippedCalls(0) {
+    invalidate();
+}
+
+void GlState::invalidate() {
+    program = kUnknown;
+    vertexArray = kUnknown;
+    for (GLuint& buffer : buffers) buffer = kUnknown;
+    readFramebuffer = drawFramebuffer = kUnknown;
+    textureUnit = kUnknown;
+    for (auto& unit : textures) {
+        for (GLuint& texture : unit) texture = kUnknown;
+    }
+    for (int& state : enabled) state = -1;
+    depthWrite = -1;
+    for (GLenum& factor : blend) factor = kUnknown;
+}
+
+bool GlState::isCurrent(bool current) {
+    if (current) skippedCalls++;
+    else issuedCalls++;
+    return current;
+}
+
+int GlState::bufferSlot(GLenum target) {
+    switch (target) {
+    case GL_ARRAY_BUFFER: return 0;
+    case GL_COPY_READ_BUFFER: return 1;
+    case GL_COPY_WRITE_BUFFER: return 2;
+    case GL_PIXEL_PACK_BUFFER: return 3;
+    case GL_PIXEL_UNPACK_BUFFER: return 4;
+    case GL_TEXTURE_BUFFER: return 5;
+    default: return -1;
+    }
+}
+
+int GlState::textureSlot(GLenum target) {
+    switch (target) {
+    case GL_TEXTURE_2D: return 0;
+    case GL_TEXTURE_BUFFER: return 1;
+    default: return -1;
+    }
+}
+
+int GlState::capabilitySlot(GLenum capability) {
+    switch (capability) {
+    case GL_DEPTH_TEST: return 0;
+    case GL_BLEND: return 1;
+    case GL_CULL_FACE: return 2;
+    case GL_SCISSOR_TEST: return 3;
+    case GL_RASTERIZER_DISCARD: return 4;
+    case GL_PROGRAM_POINT_SIZE: return 5;
+    default: return -1;
+    }
+}
+
+void GlState::useProgram(GLuint id) {
+    if (isCurrent(program == id)) return;
+    program = id;
+    glUseProgram(id);
+}
+
+void GlState::bindVertexArray(GLuint id) {
+    if (isCurrent(vertexArray == id)) return;
+    vertexArray = id;
+    glBindVertexArray(id);
+}
+
+void GlState::bindBuffer(GLenum target, GLuint buffer) {
+    int slot = bufferSlot(target);
+    if (slot >= 0) {
+        if (isCurrent(buffers[slot] == buffer)) return;
+        buffers[slot] = buffer;
+    }
+    else {
+        issuedCalls++;
+    }
+    glBindBuffer(target, buffer);
+}
+
+void GlState::bindFramebuffer(GLenum target, GLuint framebuffer) {
+    bool read = target != GL_DRAW_FRAMEBUFFER;
+    bool draw = target != GL_READ_FRAMEBUFFER;
+    if (isCurrent((!read || readFramebuffer == framebuffer) && (!draw || drawFramebuffer == framebuffer))) return;
+    if (read) readFramebuffer = framebuffer;
+    if (draw) drawFramebuffer = framebuffer;
+    glBindFramebuffer(target, framebuffer);
+}
+
+GLuint GlState::getFramebuffer(GLenum target) {
+    bool read = target == GL_READ_FRAMEBUFFER;
+    GLuint& framebuffer = read ? readFramebuffer : drawFramebuffer;
+    if (framebuffer == kUnknown) {
+        GLint binding = 0;
+        glGetIntegerv(read ? GL_READ_FRAMEBUFFER_BINDING : GL_DRAW_FRAMEBUFFER_BINDING, &binding);
+        framebuffer = static_cast<GLuint>(binding);
+    }
+    return framebuffer;
+}
+
+void GlState::activeTexture(GLenum unit) {
+    if (isCurrent(textureUnit == unit)) return;
+    textureUnit = unit;
+    glActiveTexture(unit);
+}
+
+void GlState::bindTexture(GLenum target, GLuint texture) {
+    int slot = textureSlot(target);
+    GLuint unit = textureUnit - GL_TEXTURE0;
+    if (slot >= 0 && textureUnit != kUnknown && unit < static_cast<GLuint>(kTextureUnits)) {
+        if (isCurrent(textures[unit][slot] == texture)) return;
+        textures[unit][slot] = texture;
+    }
+    else {
+        issuedCalls++;
+    }
+    glBindTexture(target, texture);
+}
+
+void GlState::setEnabled(GLenum capability, bool enable) {
+    int slot = capabilitySlot(capability);
+    if (slot >= 0) {
+        if (isCurrent(enabled[slot] == (enable ? 1 : 0))) return;
+        enabled[slot] = enable ? 1 : 0;
+    }
+    else {
+        issuedCalls++;
+    }
+    if (enable) glEnable(capability);
+    else glDisable(capability);
+}
+
+bool GlState::isEnabled(GLenum capability) {
+    int slot = capabilitySlot(capability);
+    if (slot < 0) return glIsEnabled(capability) == GL_TRUE;
+    if (enabled[slot] < 0) enabled[slot] = glIsEnabled(capability) == GL_TRUE ? 1 : 0;
+    return enabled[slot] == 1;
+}
+
+void GlState::depthMask(bool write) {
+    if (isCurrent(depthWrite == (write ? 1 : 0))) return;
+    depthWrite = write ? 1 : 0;
+    glDepthMask(write ? GL_TRUE : GL_FALSE);
+}
+
+void GlState::blendFunc(GLenum source, GLenum destination) {
+    blendFuncSeparate(source, destination, source, destination);
+}
+
+void GlState::blendFuncSeparate(GLenum sourceRgb, GLenum destinationRgb, GLenum sourceAlpha, GLenum destinationAlpha) {
+    if (isCurrent(blend[0] == sourceRgb && blend[1] == destinationRgb && blend[2] == sourceAlpha &&
+        blend[3] == destinationAlpha)) return;
+    blend[0] = sourceRgb;
+    blend[1] = destinationRgb;
+    blend[2] = sourceAlpha;
+    blend[3] = destinationAlpha;
+    glBlendFuncSeparate(sourceRgb, destinationRgb, sourceAlpha, destinationAlpha);
+}
+
+void GlState::deleteVertexArrays(GLsizei count, const GLuint* ids) {
+    for (GLsizei i = 0; i < count; ++i) {
+        if (vertexArray == ids[i]) vertexArray = 0;
+    }
+    glDeleteVertexArrays(count, ids);
+}
+
+void GlState::deleteBuffers(GLsizei count, const GLuint* ids) {
+    for (GLsizei i = 0; i < count; ++i) {
+        for (GLuint& buffer : buffers) {
+            if (buffer == ids[i]) buffer = 0;
+        }
+    }
+    glDeleteBuffers(count, ids);
+}
+
+void GlState::deleteTextures(GLsizei count, const GLuint* ids) {
+    for (GLsizei i = 0; i < count; ++i) {
+        for (auto& unit : textures) {
+            for (GLuint& texture : unit) {
+                if (texture == ids[i]) texture = 0;
+            }
+        }
+    }
+    glDeleteTextures(count, ids);
+}
+
+void GlState::deleteFramebuffers(GLsizei count, const GLuint* ids) {
+    for (GLsizei i = 0; i < count; ++i) {
+        if (readFramebuffer == ids[i]) readFramebuffer = 0;
+        if (drawFramebuffer == ids[i]) drawFramebuffer = 0;
+    }
+    glDeleteFramebuffers(count, ids);
+}
+
+void GlState::publishCounters() {
+    profiler.setCounter("GL state calls", static_cast<double>(issuedCalls));
+    profiler.setCounter("GL state calls skipped", static_cast<double>(skippedCalls));
+    issuedCalls = 0;
+    skippedCalls = 0;
+}
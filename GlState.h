@@ -0,0 +1,58 @@
+// GlState.h
+#pragma once
+#include <cstddef>
+#include <glad/glad.h>
+
+// Shadow copy of the GL bindings and switches the renderer changes: a call that would set what is
+// already current is skipped. The cache only holds while every change goes through glState, so
+// code that talks to GL directly (the ImGui backend) is followed by invalidate(). Objects are
+// deleted through it as well, since GL unbinds a deleted name and a new object may reuse it.
+class GlState {
+public:
+    GlState();
+    void useProgram(GLuint program);
+    void bindVertexArray(GLuint vertexArray);
+    // GL_ELEMENT_ARRAY_BUFFER belongs to the bound vertex array and always goes to GL
+    void bindBuffer(GLenum target, GLuint buffer);
+    // GL_FRAMEBUFFER sets the read and the draw binding
+    void bindFramebuffer(GLenum target, GLuint framebuffer);
+    GLuint getFramebuffer(GLenum target);   // GL_FRAMEBUFFER reads the draw binding
+    void activeTexture(GLenum unit);
+    void bindTexture(GLenum target, GLuint texture);    // on the active unit
+    void setEnabled(GLenum capability, bool enabled);
+    bool isEnabled(GLenum capability);
+    void depthMask(bool write);
+    void blendFunc(GLenum source, GLenum destination);
+    void blendFuncSeparate(GLenum sourceRgb, GLenum destinationRgb, GLenum sourceAlpha, GLenum destinationAlpha);
+    void deleteVertexArrays(GLsizei count, const GLuint* vertexArrays);
+    void deleteBuffers(GLsizei count, const GLuint* buffers);
+    void deleteTextures(GLsizei count, const GLuint* textures);
+    void deleteFramebuffers(GLsizei count, const GLuint* framebuffers);
+    // Forget everything; the next call of each kind goes to GL
+    void invalidate();
+    // Calls made and skipped since the last publish, as profiler counters; once per frame
+    void publishCounters();
+private:
+    static constexpr GLuint kUnknown = ~0u;
+    static constexpr int kBufferTargets = 6;
+    static constexpr int kTextureUnits = 8;
+    static constexpr int kTextureTargets = 2;
+    static constexpr int kCapabilities = 6;
+    GLuint program;
+    GLuint vertexArray;
+    GLuint buffers[kBufferTargets];
+    GLuint readFramebuffer, drawFramebuffer;
+    GLenum textureUnit;     // GL_TEXTURE0 + i, kUnknown
+    GLuint textures[kTextureUnits][kTextureTargets];
+    int enabled[kCapabilities];     // 1, 0 or -1 for unknown
+    int depthWrite;
+    GLenum blend[4];
+    size_t issuedCalls, skippedCalls;
+    bool isCurrent(bool current);   // counts the call either way
+    static int bufferSlot(GLenum target);
+    static int textureSlot(GLenum target);
+    static int capabilitySlot(GLenum capability);
+};
+
+// GL thread only
+extern GlState glState;
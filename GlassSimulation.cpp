@@ -1,117 +1,307 @@
 // GlassSimulation.cpp
 #include "GlassSimulation.h"
+#include "GlState.h"
 #include "Globals.h"
 #include "Logger.h"
+#include "imgui.h"
 #include <glm/gtc/matrix_transform.hpp>
+#include <cstddef>
 #include <cstdlib>
 #include <cmath>
 #include <vector>
-#include <array>
 #include <random>
-
-// Helper functions for vertex operations
-static float computeArea(const Vertex& v0, const Vertex& v1, const Vertex& v2) {
-    glm::vec3 a = v1.Position - v0.Position;
-    glm::vec3 b = v2.Position - v0.Position;
-    return 0.5f * glm::length(glm::cross(a, b));
-}
-
-static Vertex midpoint(const Vertex& v0, const Vertex& v1) {
-    Vertex m;
-    m.Position = (v0.Position + v1.Position) * 0.5f;
-    m.Normal = glm::normalize(v0.Normal + v1.Normal);
-    return m;
-}
-
-// Recursively subdivide a triangle into smaller triangles below a given area threshold
-static std::vector<std::array<Vertex, 3>> subdivideTriangle(const Vertex& v0, const Vertex& v1, const Vertex& v2, float threshold) {
-    std::vector<std::array<Vertex, 3>> result;
-    float area = computeArea(v0, v1, v2);
-    if (area <= threshold) {
-        // Add random perturbation
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        std::uniform_real_distribution<float> dis(-0.005f, 0.005f);
-        std::array<Vertex, 3> tri = { v0, v1, v2 };
-        for (auto& v : tri) {
-            v.Position.x += dis(gen);
-            v.Position.y += dis(gen);
-            v.Position.z += dis(gen);
-        }
-        result.push_back(tri);
-    }
-    else {
-        Vertex m0 = midpoint(v0, v1);
-        Vertex m1 = midpoint(v1, v2);
-        Vertex m2 = midpoint(v2, v0);
-        auto t1 = subdivideTriangle(v0, m0, m2, threshold);
-        auto t2 = subdivideTriangle(m0, v1, m1, threshold);
-        auto t3 = subdivideTriangle(m2, m1, v2, threshold);
-        auto t4 = subdivideTriangle(m0, m1, m2, threshold);
-        result.insert(result.end(), t1.begin(), t1.end());
-        result.insert(result.end(), t2.begin(), t2.end());
-        result.insert(result.end(), t3.begin(), t3.end());
-        result.insert(result.end(), t4.begin(), t4.end());
-    }
-    return result;
-}
-
-// Create fragments from a single mesh using subdivision
-static std::vector<Mesh> fragmentMesh(const Mesh& original, float areaThreshold) {
-    std::vector<Mesh> fragments;
-    // For each triangle in the mesh
-    for (size_t i = 0; i < original.indices.size(); i += 3) {
-        Vertex v0 = original.vertices[original.indices[i]];
-        Vertex v1 = original.vertices[original.indices[i + 1]];
-        Vertex v2 = original.vertices[original.indices[i + 2]];
-        auto tris = subdivideTriangle(v0, v1, v2, areaThreshold);
-        for (auto& tri : tris) {
-            std::vector<Vertex> verts = { tri[0], tri[1], tri[2] };
-            std::vector<unsigned int> inds = { 0, 1, 2 };
-            fragments.push_back(Mesh(verts, inds));
-        }
-    }
-    return fragments;
-}
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
 
 GlassSimulation::GlassSimulation()
-    : fallHeight(10.0f), impactAngle(45.0f), simulationTime(0.0f)
+    : fallHeight(10.0f), impactAngle(45.0f), dustCount(20000), gpuDust(false), captureTrajectory(false),
+      glassCount(1), glassSpacing(1.5f), heightJitter(0.3f),
+      adaptiveLod(true), fragmentBudget(250000), minFragmentPixels(24.0f), bakeSettled(true), frustumCulling(true),
+      occlusionCulling(true), orderIndependent(true), depthSort(true),
+      dustParticles(nullptr), gpuDustParticles(nullptr), recording(false), replaying(false), replayFrame(0),
+      playbackActive(false), playbackPaused(false), playbackFrame(0), playbackClock(0.0f), playbackSpeed(1.0f),
+      trianglesDirty(false), maxTriangleTexels(0), viewportHeight(720.0f), frameWidth(0), frameHeight(0), frameOit(false),
+      fragmentSetChanged(true), drawnFragments(0), frustumCulled(0), occlusionCulled(0),
+      bakedVAO(0), bakedVBO(0), bakedVertexCount(0), bakedVertexCapacity(0)
 {
-    state = State::FALLING;
-    glassPosition = glm::vec3(0.0f, fallHeight, 0.0f);
-    glassVelocity = glm::vec3(0.0f);
     glassModel = new Model("assets/glass.obj");
-    if (!glassModel) {
-        logger.addLog(" Failed to load glass model.");
+    if (glassModel->meshes.empty()) {
+        logger.addLog(LogLevel::Error, "Failed to load glass model.");
     }
-    glassShader = new Shader("shaders/glass.vert", "shaders/glass.frag");
-    if (!glassShader->ID) {
-        logger.addLog(" Failed to load glass shader.");
+    for (auto& variants : glassVariants) {
+        for (Shader*& variant : variants) variant = nullptr;
     }
+    templates = new FractureTemplateCache(glassModel->meshes);
+    hiZ = new HiZCuller();
+    oit = new OitRenderer();
+    depthSorter = new RadixSorter();
+    initFractureLod();
+    initInstancing();
+    spawnGlasses(std::random_device{}());
     initPlane();
 }
 
 GlassSimulation::~GlassSimulation() {
+    clearGlasses();
+    delete templates;
+    delete hiZ;
+    delete oit;
+    delete depthSorter;
     delete glassModel;
-    delete glassShader;
+    for (auto& variants : glassVariants) {
+        for (Shader* variant : variants) delete variant;
+    }
     delete planeShader;
-    glDeleteVertexArrays(1, &planeVAO);
-    glDeleteBuffers(1, &planeVBO);
-    // Free allocated fragment meshes
-    for (auto& frag : fragments) {
-        delete frag.mesh;
+    glState.deleteVertexArrays(1, &planeVAO);
+    glState.deleteBuffers(1, &planeVBO);
+    glState.deleteVertexArrays(1, &fragmentVAO);
+    glState.deleteBuffers(1, &fragmentInstanceVBO);
+    glState.deleteBuffers(1, &glassInstanceVBO);
+    glState.deleteTextures(1, &triangleTexture);
+    glState.deleteBuffers(1, &triangleBuffer);
+    glState.deleteVertexArrays(1, &bakedVAO);
+    glState.deleteBuffers(1, &bakedVBO);
+}
+
+void GlassSimulation::clearGlasses() {
+    for (auto& glass : glasses) {
+        delete glass.core;
+    }
+    glasses.clear();
+}
+
+size_t GlassSimulation::getFragmentCount() const {
+    size_t count = getBakedFragmentCount();
+    for (const auto& glass : glasses) {
+        if (glass.core) count += glass.core->getFragments().size();
+    }
+    return count;
+}
+
+// Glass 0 always takes the seed and fallHeight unchanged so a single-glass scene (and the
+// recorded glass) behaves exactly like the headless core given the same params
+void GlassSimulation::spawnGlasses(uint32_t seed) {
+    TRACE_SCOPE("GlassSimulation::spawnGlasses");
+    finishTrajectory();
+    clearGlasses();
+    bakedVertexCount = 0;
+    fragmentRefs.clear();
+    fragmentSpheres.clear();
+    fragmentBvh.build(fragmentSpheres);
+    fragmentSetChanged = true;
+    size_t count = static_cast<size_t>(std::max(glassCount, 1));
+    int side = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(count))));
+    std::mt19937 layoutRng(seed);
+    glasses.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        float col = static_cast<float>(i % side) - (side - 1) * 0.5f;
+        float row = static_cast<float>(i / side) - (side - 1) * 0.5f;
+        float jitter = i == 0 ? 0.0f : (layoutRng() / 4294967295.0f * 2.0f - 1.0f) * heightJitter;
+        float yaw = i == 0 ? 0.0f : layoutRng() / 4294967295.0f * 360.0f;
+        SimulationParams params;
+        params.fallHeight = fallHeight * (1.0f + jitter);
+        params.impactAngle = impactAngle;
+        params.seed = seed + static_cast<uint32_t>(i) * 0x9e3779b9u;
+        GlassInstance glass;
+        glass.core = new SimulationCore(*templates);
+        glass.core->reset(params);
+        glass.transform = glm::translate(glm::mat4(1.0f), glm::vec3(col * glassSpacing, 0.0f, row * glassSpacing));
+        glass.transform = glm::rotate(glass.transform, glm::radians(yaw), glm::vec3(0.0f, 1.0f, 0.0f));
+        glass.rotation = glm::angleAxis(glm::radians(yaw), glm::vec3(0.0f, 1.0f, 0.0f));
+        glass.lod = 0;
+        glasses.push_back(glass);
+    }
+}
+
+void GlassSimulation::finishTrajectory() {
+    if (!trajectoryWriter.isOpen()) return;
+    size_t frames = trajectoryWriter.getFrameCount();
+    if (!trajectoryWriter.close()) return;
+    if (captureTrajectory) {
+        logger.addLog("Trajectory with " + std::to_string(frames) + " frames written to trajectory.gstj");
+        playbackReader.openMapped("trajectory.gstj");
+    }
+    else {
+        playbackReader.openMemory(trajectoryWriter.takeMemory());
+    }
+}
+
+bool GlassSimulation::openTrajectory(const std::string& path) {
+    if (!playbackReader.openMapped(path)) return false;
+    logger.addLog("Mapped trajectory " + path + " (" + std::to_string(playbackReader.getFrameCount()) + " frames)");
+    startPlayback();
+    return true;
+}
+
+void GlassSimulation::startPlayback() {
+    if (!playbackReader.isOpen() || playbackReader.getFrameCount() == 0) return;
+    replaying = false;
+    recording = false;
+    // The reader's triangle storage is reused between trajectories, so never trust a cached base
+    clearTriangles();
+    playbackActive = true;
+    playbackPaused = false;
+    playbackFrame = 0;
+    playbackClock = playbackReader.getFrameTime(0);
+}
+
+void GlassSimulation::stopPlayback() {
+    if (!playbackActive) return;
+    playbackActive = false;
+    clearTriangles();
+}
+
+void GlassSimulation::advancePlayback(float dt) {
+    if (playbackPaused) return;
+    playbackClock += dt * playbackSpeed;
+    size_t last = playbackReader.getFrameCount() - 1;
+    while (playbackFrame < last && playbackReader.getFrameTime(playbackFrame + 1) <= playbackClock)
+        playbackFrame++;
+    if (playbackFrame == last) playbackPaused = true;
+}
+
+void GlassSimulation::drawPlaybackControls() {
+    if (!playbackReader.isOpen()) {
+        ImGui::TextDisabled("No trajectory recorded yet");
+    }
+    else if (!playbackActive) {
+        if (ImGui::Button("Play Back Last Shatter")) startPlayback();
+    }
+    else {
+        int frame = static_cast<int>(playbackFrame);
+        // Seeking decodes at most one chunk, starting from its keyframe
+        if (ImGui::SliderInt("Timeline", &frame, 0, static_cast<int>(playbackReader.getFrameCount()) - 1)) {
+            playbackFrame = static_cast<size_t>(frame);
+            playbackClock = playbackReader.getFrameTime(playbackFrame);
+        }
+        if (ImGui::Button(playbackPaused ? "Play" : "Pause")) {
+            if (playbackPaused && playbackFrame + 1 == playbackReader.getFrameCount()) {
+                playbackFrame = 0;
+                playbackClock = playbackReader.getFrameTime(0);
+            }
+            playbackPaused = !playbackPaused;
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Exit Playback")) stopPlayback();
+        ImGui::SliderFloat("Speed", &playbackSpeed, 0.1f, 4.0f);
+        ImGui::Text("t = %.3f s", playbackReader.getFrameTime(playbackFrame));
     }
+    if (ImGui::Button("Open trajectory.gstj")) openTrajectory("trajectory.gstj");
 }
 
 void GlassSimulation::resetSimulation() {
-    simulationTime = 0.0f;
-    state = State::FALLING;
-    glassPosition = glm::vec3(0.0f, fallHeight, 0.0f);
-    glassVelocity = glm::vec3(0.0f);
-    for (auto& frag : fragments) {
-        delete frag.mesh;
+    stopPlayback();
+    replaying = false;
+    recording = false;
+    spawnGlasses(std::random_device{}());
+}
+
+void GlassSimulation::startRecording() {
+    resetSimulation();
+    record = SimulationRecording();
+    record.params = glasses[0].core->getParams();
+    recording = true;
+    logger.addLog("Recording simulation (seed " + std::to_string(record.params.seed) + ").");
+}
+
+bool GlassSimulation::stopRecording(const std::string& path) {
+    if (!recording) return false;
+    recording = false;
+    // The LOD pass may have picked a coarser threshold after the recording started
+    record.params = glasses[0].core->getParams();
+    record.finalHash = glasses[0].core->stateHash();
+    if (!record.save(path)) return false;
+    logger.addLog("Saved " + std::to_string(record.frameDts.size()) + " frames to " + path);
+    return true;
+}
+
+bool GlassSimulation::startReplay(const std::string& path) {
+    if (!record.load(path)) return false;
+    stopPlayback();
+    recording = false;
+    fallHeight = record.params.fallHeight;
+    impactAngle = record.params.impactAngle;
+    spawnGlasses(record.params.seed);
+    glasses[0].core->reset(record.params);
+    replaying = true;
+    replayFrame = 0;
+    logger.addLog("Replaying " + std::to_string(record.frameDts.size()) + " frames from " + path);
+    return true;
+}
+
+bool GlassSimulation::verifyRecording(const std::string& path) {
+    SimulationRecording recordingToCheck;
+    if (!recordingToCheck.load(path)) return false;
+    uint64_t hash = 0;
+    bool match = replayHeadless(recordingToCheck, glassModel->meshes, &hash);
+    logger.addLog(match ? LogLevel::Info : LogLevel::Error,
+        std::string("Headless replay of ") + path + (match ? " matches" : " diverged from") + " the recorded final state.");
+    return match;
+}
+
+void GlassSimulation::setParticleSystem(ParticleSystem* particles) {
+    dustParticles = particles;
+    // Size the scratch once so a shatter never allocates
+    if (dustParticles) dustBatch.reserve(dustParticles->getCapacity());
+}
+
+// xorshift32: dust needs volume, not quality, and mt19937 would dominate a 50k burst
+static inline float fastRandom01(uint32_t& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return (state >> 8) * (1.0f / 16777216.0f);
+}
+
+void GlassSimulation::emitDust(const GlassInstance& glass) {
+    const std::vector<FragmentSim>& fragments = glass.core->getFragments();
+    if (gpuDust && gpuDustParticles) {
+        // Slots are initialised by the update shader, the burst costs a few uniforms: the sites
+        // are fragment centroids, spread over the fragments when there are more than fit
+        if (dustCount <= 0 || fragments.empty()) return;
+        const std::vector<glm::vec4>& bounds = glass.core->getTemplate()->bounds;
+        size_t siteCount = std::min(fragments.size(), GpuParticleSystem::kMaxSpawnSites);
+        dustSites.resize(siteCount);
+        for (size_t i = 0; i < siteCount; ++i) {
+            size_t index = i * fragments.size() / siteCount;
+            dustSites[i] = glm::vec3(glass.transform * glm::vec4(fragments[index].position + glm::vec3(bounds[index]), 1.0f));
+        }
+        gpuDustParticles->emit(dustSites.data(), siteCount, impactAngle, static_cast<unsigned int>(dustCount));
+        return;
     }
-    fragments.clear();
+    if (!dustParticles || fragments.empty() || dustCount <= 0) return;
+    const std::vector<Vertex>& triangles = glass.core->getTemplate()->triangles;
+    size_t count = std::min(static_cast<size_t>(dustCount), dustParticles->getCapacity() - dustParticles->getLiveCount());
+    dustBatch.resize(count);
+    // From the glass's seed, scrambled so it does not track the core's own rng: a replay or a
+    // recording sheds the same dust
+    uint32_t state = (glass.core->getParams().seed ^ 0x2545f491u) * 0x9e3779b9u | 1u;
+    glm::mat3 rotation(glass.transform);
+    glm::vec3 origin(glass.transform[3]);
+    for (size_t i = 0; i < count; ++i) {
+        // Sample a point on a fragment triangle so the dust comes from the fracture sites
+        size_t index = i % fragments.size();
+        const FragmentSim& frag = fragments[index];
+        const Vertex* verts = &triangles[index * 3];
+        float u = fastRandom01(state);
+        float v = fastRandom01(state);
+        if (u + v > 1.0f) {
+            u = 1.0f - u;
+            v = 1.0f - v;
+        }
+        glm::vec3 local = verts[0].Position + u * (verts[1].Position - verts[0].Position) + v * (verts[2].Position - verts[0].Position);
+        Particle& p = dustBatch[i];
+        p.position = origin + rotation * (frag.position + local);
+        // Outward from the glass axis with an upward kick
+        glm::vec3 outward = glm::vec3(local.x, 0.0f, local.z);
+        float radius = glm::length(outward);
+        if (radius > 1e-4f) outward /= radius;
+        p.velocity = rotation * (outward * (fastRandom01(state) * 3.0f) + frag.velocity * 0.3f);
+        p.velocity.y += fastRandom01(state) * 2.0f;
+        p.life = 1.5f + fastRandom01(state) * 1.5f;
+    }
+    dustParticles->emitBatch(dustBatch.data(), count);
 }
 
 void GlassSimulation::initPlane() {
@@ -123,129 +313,552 @@ void GlassSimulation::initPlane() {
     };
     glGenVertexArrays(1, &planeVAO);
     glGenBuffers(1, &planeVBO);
-    glBindVertexArray(planeVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, planeVBO);
+    glState.bindVertexArray(planeVAO);
+    glState.bindBuffer(GL_ARRAY_BUFFER, planeVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(planeVertices), planeVertices, GL_STATIC_DRAW);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
-    glBindVertexArray(0);
+    glState.bindVertexArray(0);
     planeShader = new Shader("shaders/plane.vert", "shaders/plane.frag");
     if (!planeShader->ID) {
-        logger.addLog(" Failed to load plane shader.");
+        logger.addLog(LogLevel::Error, "Failed to load plane shader.");
+    }
+}
+
+void GlassSimulation::initInstancing() {
+    glGenBuffers(1, &glassInstanceVBO);
+    for (auto& mesh : glassModel->meshes) {
+        mesh.setInstanceBuffer(glassInstanceVBO);
+    }
+    // Fragments have no vertex buffer: gl_VertexID and the instance's triangle index fetch the
+    // vertex from the triangle texture buffer
+    glGenVertexArrays(1, &fragmentVAO);
+    glGenBuffers(1, &fragmentInstanceVBO);
+    glState.bindVertexArray(fragmentVAO);
+    glState.bindBuffer(GL_ARRAY_BUFFER, fragmentInstanceVBO);
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(FragmentInstance), (void*)offsetof(FragmentInstance, transform));
+    glVertexAttribDivisor(2, 1);
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(FragmentInstance), (void*)(offsetof(FragmentInstance, transform) + offsetof(InstanceTransform, translation)));
+    glVertexAttribDivisor(3, 1);
+    glEnableVertexAttribArray(4);
+    glVertexAttribIPointer(4, 1, GL_UNSIGNED_INT, sizeof(FragmentInstance), (void*)offsetof(FragmentInstance, triangle));
+    glVertexAttribDivisor(4, 1);
+    glState.bindVertexArray(0);
+    // The texture keeps pointing at the buffer object while uploads replace its storage
+    glGenBuffers(1, &triangleBuffer);
+    glGenTextures(1, &triangleTexture);
+    glState.bindBuffer(GL_TEXTURE_BUFFER, triangleBuffer);
+    glState.bindTexture(GL_TEXTURE_BUFFER, triangleTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, triangleBuffer);
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTriangleTexels);
+}
+
+uint32_t GlassSimulation::getTriangleBase(const std::vector<Vertex>& triangles) {
+    auto found = triangleBase.find(&triangles);
+    if (found != triangleBase.end()) return found->second;
+    uint32_t base = static_cast<uint32_t>(triangleTexels.size() / 6);
+    triangleBase[&triangles] = base;
+    for (const auto& v : triangles) {
+        triangleTexels.push_back(glm::vec4(v.Position, 1.0f));
+        triangleTexels.push_back(glm::vec4(v.Normal, 0.0f));
+    }
+    trianglesDirty = true;
+    return base;
+}
+
+void GlassSimulation::clearTriangles() {
+    triangleBase.clear();
+    triangleTexels.clear();
+    trianglesDirty = true;
+}
+
+float GlassSimulation::lodThreshold(int lod) const {
+    return SimulationParams().areaThreshold * static_cast<float>(1 << (2 * lod));
+}
+
+// Builds every level's template up front so a shatter never pays for subdivision
+void GlassSimulation::initFractureLod() {
+    TRACE_SCOPE("GlassSimulation::initFractureLod");
+    for (int lod = 0; lod <= kMaxFractureLod; ++lod)
+        lodFragments[lod] = templates->get(lodThreshold(lod)).getFragmentCount();
+    glm::vec3 lo(1e30f), hi(-1e30f);
+    for (const auto& mesh : glassModel->meshes) {
+        for (const auto& v : mesh.vertices) {
+            lo = glm::min(lo, v.Position);
+            hi = glm::max(hi, v.Position);
+        }
+    }
+    modelCenter = (lo + hi) * 0.5f;
+    modelRadius = glassModel->meshes.empty() ? 0.0f : glm::length(hi - lo) * 0.5f;
+}
+
+void GlassSimulation::chooseFractureLod() {
+    PROFILE_SCOPE("fractureLod");
+    // Fragments already on the floor are spent; falling glasses share what is left
+    long long remaining = fragmentBudget - static_cast<long long>(getBakedFragmentCount());
+    lodOrder.clear();
+    float pixelsPerUnit = viewportHeight * 0.5f / std::tan(glm::radians(camera.zoom) * 0.5f);
+    for (size_t i = 0; i < glasses.size(); ++i) {
+        GlassInstance& glass = glasses[i];
+        if (!glass.core) continue;
+        const SimulationCore& core = *glass.core;
+        if (core.getState() != SimulationCore::State::FALLING) {
+            remaining -= static_cast<long long>(core.getFragments().size());
+            continue;
+        }
+        // The replayed glass must fracture exactly as recorded
+        if (replaying && i == 0) {
+            remaining -= static_cast<long long>(templates->get(core.getParams().areaThreshold).getFragmentCount());
+            continue;
+        }
+        glm::vec3 center = glm::vec3(glass.transform * glm::vec4(core.getGlassPosition() + modelCenter, 1.0f));
+        float distance = std::max(glm::length(center - camera.position), 0.1f);
+        float radiusPixels = modelRadius * pixelsPerUnit / distance;
+        // Finest level whose fragments still cover minFragmentPixels of the glass's screen disc
+        float screenArea = 3.14159265f * radiusPixels * radiusPixels;
+        int lod = 0;
+        while (lod < kMaxFractureLod && screenArea / lodFragments[lod] < minFragmentPixels) ++lod;
+        glass.lod = lod;
+        remaining -= static_cast<long long>(lodFragments[lod]);
+        lodOrder.push_back(std::make_pair(radiusPixels, i));
+    }
+    // Over budget: coarsen the smallest glasses first, one level per pass
+    std::sort(lodOrder.begin(), lodOrder.end());
+    bool coarsened = true;
+    while (remaining < 0 && coarsened) {
+        coarsened = false;
+        for (size_t k = 0; k < lodOrder.size() && remaining < 0; ++k) {
+            GlassInstance& glass = glasses[lodOrder[k].second];
+            if (glass.lod == kMaxFractureLod) continue;
+            remaining += static_cast<long long>(lodFragments[glass.lod] - lodFragments[glass.lod + 1]);
+            glass.lod++;
+            coarsened = true;
+        }
+    }
+    for (const auto& entry : lodOrder) {
+        GlassInstance& glass = glasses[entry.second];
+        glass.core->setAreaThreshold(lodThreshold(glass.lod));
     }
 }
 
 void GlassSimulation::update(float dt) {
-    simulationTime += dt;
-    if (state == State::FALLING) {
-        float displacement = 0.5f * gravity * simulationTime * simulationTime;
-        glassPosition.y = fallHeight - displacement;
-        if (glassPosition.y <= 0.0f) {
-            glassPosition.y = 0.0f;
-            state = State::SHATTERED;
-            // Clear previous fragments and free memory
-            for (auto& frag : fragments) {
-                delete frag.mesh;
+    TRACE_SCOPE("GlassSimulation::update");
+    if (playbackActive) {
+        // Playback only renders recorded transforms; the live cores stay paused
+        advancePlayback(dt);
+        return;
+    }
+    if (replaying) {
+        // The recording supplies the timestep, wall-clock dt is ignored
+        if (replayFrame < record.frameDts.size()) {
+            dt = record.frameDts[replayFrame++];
+        }
+        else {
+            replaying = false;
+            bool match = glasses[0].core->stateHash() == record.finalHash;
+            logger.addLog(match ? LogLevel::Info : LogLevel::Error,
+                match ? "Replay finished: state matches the recording." : "Replay finished: state diverged from the recording.");
+        }
+    }
+    if (recording) record.frameDts.push_back(dt);
+    if (adaptiveLod) chooseFractureLod();
+    shatteredThisStep.clear();
+    {
+        PROFILE_SCOPE("glasses.step");
+        for (size_t i = 0; i < glasses.size(); ++i) {
+            SimulationCore* core = glasses[i].core;
+            if (!core) continue;
+            SimulationCore::State before = core->getState();
+            core->update(dt);
+            if (before == SimulationCore::State::FALLING) {
+                if (core->getState() != SimulationCore::State::FALLING) shatteredThisStep.push_back(i);
             }
-            fragments.clear();
-            // If more than one mesh exists, use them; otherwise, subdivide the single mesh
-            if (glassModel->meshes.size() > 1) {
-                for (auto& mesh : glassModel->meshes) {
-                    std::vector<Mesh> fragMeshes = fragmentMesh(mesh, 0.005f);
-                    for (auto& fragMesh : fragMeshes) {
-                        FragmentSim frag;
-                        frag.position = glassPosition;
-                        float speed = ((rand() % 100) / 100.0f) * 5.0f;
-                        float angleRad = glm::radians(impactAngle + ((rand() % 50) - 25) * 0.1f);
-                        frag.velocity = glm::vec3(speed * cos(angleRad),
-                            speed * sin(angleRad),
-                            ((rand() % 100) / 100.0f) * 5.0f);
-                        frag.rotationAxis = glm::normalize(glm::vec3(((rand() % 100) / 100.0f),
-                            ((rand() % 100) / 100.0f),
-                            ((rand() % 100) / 100.0f)));
-                        frag.rotationAngle = 0.0f;
-                        frag.angularVelocity = ((rand() % 100) / 100.0f) * 90.0f;
-                        // Allocate a new mesh for this fragment
-                        frag.mesh = new Mesh(fragMeshes.back());
-                        fragMeshes.pop_back();
-                        fragments.push_back(frag);
-                    }
+            else if (i == 0 && before == SimulationCore::State::SHATTERED) {
+                trajectoryWriter.writeFrame(core->getSimulationTime(), core->getFragments());
+                if (core->getState() == SimulationCore::State::SIMULATION_DONE) {
+                    logger.addLog("Fragment simulation complete.");
+                    finishTrajectory();
                 }
             }
-            else {
-                std::vector<Mesh> fragMeshes = fragmentMesh(glassModel->meshes[0], 0.005f);
-                for (auto& subMesh : fragMeshes) {
-                    FragmentSim frag;
-                    frag.position = glassPosition;
-                    float speed = ((rand() % 100) / 100.0f) * 5.0f;
-                    float angleRad = glm::radians(impactAngle + ((rand() % 50) - 25) * 0.1f);
-                    frag.velocity = glm::vec3(speed * cos(angleRad),
-                        speed * sin(angleRad),
-                        ((rand() % 100) / 100.0f) * 5.0f);
-                    frag.rotationAxis = glm::normalize(glm::vec3(((rand() % 100) / 100.0f),
-                        ((rand() % 100) / 100.0f),
-                        ((rand() % 100) / 100.0f)));
-                    frag.rotationAngle = 0.0f;
-                    frag.angularVelocity = ((rand() % 100) / 100.0f) * 90.0f;
-                    frag.mesh = new Mesh(subMesh);
-                    fragments.push_back(frag);
-                }
+        }
+    }
+    if (bakeSettled) bakeSettledGlasses();
+    if (!shatteredThisStep.empty()) {
+        PROFILE_SCOPE("shatter");
+        auto start = std::chrono::high_resolution_clock::now();
+        size_t fragmentCount = 0;
+        for (size_t i : shatteredThisStep) {
+            onShatter(i);
+            fragmentCount += glasses[i].core->getFragments().size();
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        char line[160];
+        snprintf(line, sizeof(line), "%zu glass(es) shattered into %zu fragments (dust and capture took %.3f ms).",
+            shatteredThisStep.size(), fragmentCount, std::chrono::duration<double, std::milli>(end - start).count());
+        logger.addLog(line);
+        fragmentSetChanged = true;
+    }
+    updateFragmentBounds();
+}
+
+// Rotates v about a unit axis (Rodrigues), cheaper than building the fragment's matrix
+static glm::vec3 rotateAboutAxis(const glm::vec3& v, const glm::vec3& axis, float degrees) {
+    float angle = glm::radians(degrees);
+    float c = std::cos(angle);
+    float s = std::sin(angle);
+    return v * c + glm::cross(axis, v) * s + axis * (glm::dot(axis, v) * (1.0f - c));
+}
+
+void GlassSimulation::updateFragmentBounds() {
+    PROFILE_SCOPE("fragmentBounds");
+    if (fragmentSetChanged) {
+        fragmentRefs.clear();
+        for (size_t g = 0; g < glasses.size(); ++g) {
+            const SimulationCore* core = glasses[g].core;
+            if (!core || core->getState() == SimulationCore::State::FALLING) continue;
+            for (size_t f = 0; f < core->getFragments().size(); ++f) {
+                FragmentRef ref = { static_cast<uint32_t>(g), static_cast<uint32_t>(f) };
+                fragmentRefs.push_back(ref);
+            }
+        }
+    }
+    fragmentSpheres.resize(fragmentRefs.size());
+    for (size_t i = 0; i < fragmentRefs.size(); ++i) {
+        const GlassInstance& glass = glasses[fragmentRefs[i].glass];
+        const FragmentSim& frag = glass.core->getFragments()[fragmentRefs[i].fragment];
+        const glm::vec4& bounds = glass.core->getTemplate()->bounds[fragmentRefs[i].fragment];
+        glm::vec3 local = frag.position + rotateAboutAxis(glm::vec3(bounds), frag.rotationAxis, frag.rotationAngle);
+        fragmentSpheres[i].center = glm::vec3(glass.transform * glm::vec4(local, 1.0f));
+        fragmentSpheres[i].radius = bounds.w;
+    }
+    if (fragmentSetChanged) fragmentBvh.build(fragmentSpheres);
+    else fragmentBvh.refit(fragmentSpheres);
+    fragmentSetChanged = false;
+}
+
+void GlassSimulation::onShatter(size_t index) {
+    const GlassInstance& glass = glasses[index];
+    if (index == 0) {
+        // Every shatter is captured so it can be played back; to disk only when asked.
+        // Drop the previous mapping first, the file may be about to be rewritten.
+        playbackReader.close();
+        const std::vector<FragmentSim>& fragments = glass.core->getFragments();
+        const std::vector<Vertex>& triangles = glass.core->getTemplate()->triangles;
+        bool opened = captureTrajectory ? trajectoryWriter.open("trajectory.gstj", fragments, triangles)
+            : trajectoryWriter.openMemory(fragments, triangles);
+        if (opened) trajectoryWriter.writeFrame(glass.core->getSimulationTime(), fragments);
+    }
+    emitDust(glass);
+}
+
+void GlassSimulation::addFragmentInstance(const GlassInstance& glass, uint32_t triangle, const glm::vec3& position,
+    float rotationAngle, const glm::vec3& rotationAxis) {
+    FragmentInstance instance;
+    instance.transform.rotation = glass.rotation * glm::angleAxis(glm::radians(rotationAngle), rotationAxis);
+    instance.transform.translation = glm::vec3(glass.transform * glm::vec4(position, 1.0f));
+    instance.triangle = triangle;
+    fragmentInstances.push_back(instance);
+}
+
+// GL thread: everything recordCommands() needs from GL, so that it can run anywhere
+void GlassSimulation::beginFrame() {
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    frameWidth = viewport[2];
+    frameHeight = viewport[3];
+    viewportHeight = static_cast<float>(frameHeight);
+    if (occlusionCulling && !playbackActive) hiZ->beginFrame();
+    // Decided before recording: once the glass pass is recorded with OIT shaders it has to be
+    // drawn with OIT
+    frameOit = orderIndependent && oit->prepare(frameWidth, frameHeight);
+    for (int draw = 0; draw < static_cast<int>(GlassDraw::Count); ++draw) {
+        if (frameOit && !getGlassShader(static_cast<GlassDraw>(draw), true).ID) frameOit = false;
+    }
+    for (int draw = 0; draw < static_cast<int>(GlassDraw::Count); ++draw) {
+        getGlassShader(static_cast<GlassDraw>(draw), frameOit);
+    }
+}
+
+void GlassSimulation::recordCommands(CommandBuffer& commands, const glm::mat4& view, const glm::mat4& projection) {
+    TRACE_SCOPE("GlassSimulation::recordCommands");
+    CommandBuffer::DrawDesc plane;
+    plane.program = planeShader->ID;
+    plane.vertexArray = planeVAO;
+    plane.mode = GL_TRIANGLE_FAN;
+    plane.count = 4;
+    commands.draw(RenderPass::Opaque, plane);
+    commands.uniform("model", glm::mat4(1.0f));
+    commands.uniform("view", view);
+    commands.uniform("projection", projection);
+    glassInstances.clear();
+    fragmentInstances.clear();
+    frustumCulled = occlusionCulled = 0;
+    if (playbackActive) {
+        if (playbackReader.readFrame(playbackFrame, playbackPoses)) {
+            uint32_t base = getTriangleBase(playbackReader.getTriangles());
+            const std::vector<glm::vec3>& axes = playbackReader.getRotationAxes();
+            for (size_t i = 0; i < playbackPoses.size(); ++i) {
+                addFragmentInstance(glasses[0], base + static_cast<uint32_t>(i), playbackPoses[i].position,
+                    playbackPoses[i].rotationAngle, axes[i]);
             }
-            logger.addLog("Glass shattered into fragments.");
-        }
-    }
-    else if (state == State::SHATTERED) {
-        bool allStopped = true;
-        for (auto& frag : fragments) {
-            if (glm::length(frag.velocity) > 0.05f)
-                allStopped = false;
-            frag.velocity.y -= gravity * dt;
-            frag.position += frag.velocity * dt;
-            frag.rotationAngle += frag.angularVelocity * dt;
-            if (frag.position.y < 0.0f) {
-                frag.position.y = 0.0f;
-                frag.velocity.y = -frag.velocity.y * restitution;
-                frag.velocity.x *= friction;
-                frag.velocity.z *= friction;
-                frag.angularVelocity *= friction;
+        }
+    }
+    else {
+        Frustum frustum = Frustum::fromMatrix(projection * view);
+        bool useHiZ = occlusionCulling && hiZ->isReady();
+        glassTriangleBase.assign(glasses.size(), 0);
+        for (size_t g = 0; g < glasses.size(); ++g) {
+            const GlassInstance& glass = glasses[g];
+            if (!glass.core) continue;
+            const SimulationCore& core = *glass.core;
+            if (core.getState() != SimulationCore::State::FALLING) {
+                glassTriangleBase[g] = getTriangleBase(core.getTemplate()->triangles);
+                continue;
             }
+            BoundingSphere sphere = { glm::vec3(glass.transform * glm::vec4(core.getGlassPosition() + modelCenter, 1.0f)), modelRadius };
+            if (frustumCulling && !frustum.intersects(sphere)) continue;
+            if (useHiZ && !hiZ->isVisible(sphere)) continue;
+            InstanceTransform instance;
+            instance.rotation = glass.rotation;
+            instance.translation = glm::vec3(glass.transform * glm::vec4(core.getGlassPosition(), 1.0f));
+            glassInstances.push_back(instance);
+        }
+        visibleFragments.clear();
+        if (frustumCulling) {
+            TRACE_SCOPE("frustumCull");
+            fragmentBvh.cull(frustum, visibleFragments);
+        }
+        else {
+            for (uint32_t i = 0; i < fragmentRefs.size(); ++i) visibleFragments.push_back(i);
+        }
+        size_t inFrustum = visibleFragments.size();
+        if (useHiZ) {
+            TRACE_SCOPE("occlusionCull");
+            visibleFragments.erase(std::remove_if(visibleFragments.begin(), visibleFragments.end(),
+                [&](uint32_t index) { return !hiZ->isVisible(fragmentSpheres[index]); }), visibleFragments.end());
         }
-        if (allStopped) {
-            state = State::SIMULATION_DONE;
-            logger.addLog("Fragment simulation complete.");
+        frustumCulled = fragmentRefs.size() - inFrustum;
+        occlusionCulled = inFrustum - visibleFragments.size();
+        for (uint32_t index : visibleFragments) {
+            const FragmentRef& ref = fragmentRefs[index];
+            const GlassInstance& glass = glasses[ref.glass];
+            const FragmentSim& frag = glass.core->getFragments()[ref.fragment];
+            addFragmentInstance(glass, glassTriangleBase[ref.glass] + ref.fragment, frag.position,
+                frag.rotationAngle, frag.rotationAxis);
         }
     }
+    drawnFragments = fragmentInstances.size();
+    // Without OIT the glass draws blend in record order; with it they sort by state
+    uint16_t order = 0;
+    if (!glassInstances.empty()) {
+        commands.upload(RenderPass::Glass, GL_ARRAY_BUFFER, glassInstanceVBO, glassInstances.data(),
+            glassInstances.size() * sizeof(InstanceTransform), 0, GL_STREAM_DRAW);
+        for (auto& mesh : glassModel->meshes) {
+            CommandBuffer::DrawDesc draw;
+            draw.program = getGlassShader(GlassDraw::Falling, frameOit).ID;
+            draw.vertexArray = mesh.VAO;
+            draw.count = static_cast<GLsizei>(mesh.indices.size());
+            draw.instanceCount = static_cast<GLsizei>(glassInstances.size());
+            draw.indexType = GL_UNSIGNED_INT;
+            draw.order = frameOit ? 0 : ++order;
+            commands.draw(RenderPass::Glass, draw);
+            commands.uniform("view", view);
+            commands.uniform("projection", projection);
+        }
+    }
+    if (bakedVertexCount > 0 && !playbackActive) {
+        CommandBuffer::DrawDesc draw;
+        draw.program = getGlassShader(GlassDraw::Baked, frameOit).ID;
+        draw.vertexArray = bakedVAO;
+        draw.count = static_cast<GLsizei>(bakedVertexCount);
+        draw.order = frameOit ? 0 : ++order;
+        commands.draw(RenderPass::Glass, draw);
+        commands.uniform("view", view);
+        commands.uniform("projection", projection);
+    }
+    if (depthSort && !frameOit) sortFragmentsByDepth(view);
+    if (!fragmentInstances.empty()) recordFragments(commands, view, projection, frameOit ? 0 : ++order);
+}
+
+// GL thread, after commands.sort(): the passes recorded above, with OIT and the Hi-Z capture
+// around them
+void GlassSimulation::submit(const CommandBuffer& commands, const glm::mat4& view, const glm::mat4& projection) {
+    profiler.setCounter("frustum culled", static_cast<double>(frustumCulled));
+    profiler.setCounter("occlusion culled", static_cast<double>(occlusionCulled));
+    profiler.setCounter("fragments drawn", static_cast<double>(drawnFragments));
+    commands.submit(RenderPass::Opaque);
+    // Only opaque geometry occludes: translucent glass and shards must not hide what shows
+    // through them, so the depth is kept before the Glass pass writes any
+    if (occlusionCulling && !playbackActive) hiZ->captureDepth(frameWidth, frameHeight, projection * view);
+    if (frameOit) oit->begin();
+    commands.submit(RenderPass::Glass);
+    if (frameOit) oit->composite();
 }
 
-void GlassSimulation::renderPlane(const glm::mat4& view, const glm::mat4& projection) {
-    glUseProgram(planeShader->ID);
-    glm::mat4 model = glm::mat4(1.0f);
-    glUniformMatrix4fv(glGetUniformLocation(planeShader->ID, "model"), 1, GL_FALSE, &model[0][0]);
-    glUniformMatrix4fv(glGetUniformLocation(planeShader->ID, "view"), 1, GL_FALSE, &view[0][0]);
-    glUniformMatrix4fv(glGetUniformLocation(planeShader->ID, "projection"), 1, GL_FALSE, &projection[0][0]);
-    glBindVertexArray(planeVAO);
-    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-    glBindVertexArray(0);
+// Built on first use; a variant that fails to build stays at ID 0 and is not retried
+Shader& GlassSimulation::getGlassShader(GlassDraw draw, bool oit) {
+    Shader*& variant = glassVariants[static_cast<int>(draw)][oit ? 1 : 0];
+    if (variant) return *variant;
+    // Falling glasses are instanced meshes, fragments are instanced triangles pulled from the
+    // triangle buffer and baked shards are already in world space
+    std::vector<std::string> defines;
+    if (draw != GlassDraw::Baked) defines.push_back("INSTANCED");
+    if (draw == GlassDraw::Fragments) defines.push_back("TRIANGLE_BUFFER");
+    if (oit) defines.push_back("OIT");
+    variant = new Shader("shaders/glass.vert", "shaders/glass.frag", defines);
+    if (!variant->ID) {
+        std::string name;
+        for (const std::string& define : defines) name += " " + define;
+        logger.addLog(LogLevel::Error, "Failed to load glass shader variant" + (name.empty() ? std::string(" (base)") : name) + ".");
+    }
+    return *variant;
 }
 
-void GlassSimulation::render(const glm::mat4& view, const glm::mat4& projection) {
-    renderPlane(view, projection);
-    glUseProgram(glassShader->ID);
-    if (state == State::FALLING) {
-        glm::mat4 model = glm::translate(glm::mat4(1.0f), glassPosition);
-        glUniformMatrix4fv(glGetUniformLocation(glassShader->ID, "model"), 1, GL_FALSE, &model[0][0]);
-        glUniformMatrix4fv(glGetUniformLocation(glassShader->ID, "view"), 1, GL_FALSE, &view[0][0]);
-        glUniformMatrix4fv(glGetUniformLocation(glassShader->ID, "projection"), 1, GL_FALSE, &projection[0][0]);
-        glassModel->Draw(*glassShader);
+void GlassSimulation::recordFragments(CommandBuffer& commands, const glm::mat4& view, const glm::mat4& projection,
+    uint16_t order) {
+    if (trianglesDirty) {
+        if (triangleTexels.size() > static_cast<size_t>(maxTriangleTexels))
+            logger.addLog(LogLevel::Error, "Fragment triangles exceed GL_MAX_TEXTURE_BUFFER_SIZE.");
+        commands.upload(RenderPass::Glass, GL_TEXTURE_BUFFER, triangleBuffer, triangleTexels.data(),
+            triangleTexels.size() * sizeof(glm::vec4), 0, GL_STATIC_DRAW);
+        trianglesDirty = false;
     }
-    else if (state == State::SHATTERED || state == State::SIMULATION_DONE) {
-        for (auto& frag : fragments) {
-            glm::mat4 model = glm::translate(glm::mat4(1.0f), frag.position);
-            model = glm::rotate(model, glm::radians(frag.rotationAngle), frag.rotationAxis);
-            glUniformMatrix4fv(glGetUniformLocation(glassShader->ID, "model"), 1, GL_FALSE, &model[0][0]);
-            glUniformMatrix4fv(glGetUniformLocation(glassShader->ID, "view"), 1, GL_FALSE, &view[0][0]);
-            glUniformMatrix4fv(glGetUniformLocation(glassShader->ID, "projection"), 1, GL_FALSE, &projection[0][0]);
-            frag.mesh->Draw(*glassShader);
+    // Orphaned on upload: the previous frame's draw may still be reading the old storage
+    commands.upload(RenderPass::Glass, GL_ARRAY_BUFFER, fragmentInstanceVBO, fragmentInstances.data(),
+        fragmentInstances.size() * sizeof(FragmentInstance), 0, GL_STREAM_DRAW);
+    CommandBuffer::DrawDesc draw;
+    draw.program = getGlassShader(GlassDraw::Fragments, frameOit).ID;
+    draw.vertexArray = fragmentVAO;
+    draw.count = 3;
+    draw.instanceCount = static_cast<GLsizei>(fragmentInstances.size());
+    draw.textureTargets[0] = GL_TEXTURE_BUFFER;
+    draw.textures[0] = triangleTexture;
+    draw.order = order;
+    commands.draw(RenderPass::Glass, draw);
+    commands.uniform("view", view);
+    commands.uniform("projection", projection);
+    commands.uniform("fragmentTriangles", 0);
+}
+
+// Back to front: ascending view-space z of each fragment's origin (the camera looks down -z)
+void GlassSimulation::sortFragmentsByDepth(const glm::mat4& view) {
+    TRACE_SCOPE("depthSort");
+    size_t count = fragmentInstances.size();
+    sortKeys.resize(count);
+    sortOrder.resize(count);
+    glm::vec3 viewZ(view[0][2], view[1][2], view[2][2]);
+    for (size_t i = 0; i < count; ++i) {
+        sortKeys[i] = RadixSorter::floatKey(glm::dot(viewZ, fragmentInstances[i].transform.translation) + view[3][2]);
+        sortOrder[i] = static_cast<uint32_t>(i);
+    }
+    depthSorter->sort(sortKeys, sortOrder);
+    sortedInstances.resize(count);
+    for (size_t i = 0; i < count; ++i) sortedInstances[i] = fragmentInstances[sortOrder[i]];
+    fragmentInstances.swap(sortedInstances);
+}
+
+void GlassSimulation::benchmarkDepthSort() {
+    std::vector<FragmentInstance> saved;
+    saved.swap(fragmentInstances);
+    glm::mat4 view = camera.getViewMatrix();
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> spread(-20.0f, 20.0f);
+    const size_t counts[] = { 10000, 100000, 1000000 };
+    const int iterations = 10;
+    for (size_t count : counts) {
+        std::vector<FragmentInstance> shuffled(count);
+        for (size_t i = 0; i < count; ++i) {
+            shuffled[i].transform.translation = glm::vec3(spread(rng), spread(rng) * 0.1f + 2.0f, spread(rng));
+            shuffled[i].triangle = static_cast<uint32_t>(i);
+        }
+        fragmentInstances = shuffled;
+        sortFragmentsByDepth(view);  // warm up scratch growth
+        double totalMs = 0.0;
+        for (int i = 0; i < iterations; ++i) {
+            fragmentInstances = shuffled;
+            auto start = std::chrono::high_resolution_clock::now();
+            sortFragmentsByDepth(view);
+            auto end = std::chrono::high_resolution_clock::now();
+            totalMs += std::chrono::duration<double, std::milli>(end - start).count();
+        }
+        char line[160];
+        snprintf(line, sizeof(line), "Depth sort: %zu fragments, %.3f ms per frame (%u threads)", count,
+            totalMs / iterations, depthSorter->getThreadCount());
+        logger.addLog(line);
+    }
+    fragmentInstances.swap(saved);
+}
+
+// Glass 0 keeps its core while a recording or replay still needs its state hash
+bool GlassSimulation::canBake(size_t glass) const {
+    const SimulationCore* core = glasses[glass].core;
+    if (!core || core->getState() != SimulationCore::State::SIMULATION_DONE) return false;
+    return glass != 0 || (!recording && !replaying);
+}
+
+void GlassSimulation::bakeSettledGlasses() {
+    settledThisStep.clear();
+    size_t vertexCount = 0;
+    for (size_t i = 0; i < glasses.size(); ++i) {
+        if (!canBake(i)) continue;
+        settledThisStep.push_back(i);
+        vertexCount += glasses[i].core->getFragments().size() * 3;
+    }
+    if (settledThisStep.empty()) return;
+    PROFILE_SCOPE("bakeSettled");
+    bakeScratch.clear();
+    bakeScratch.reserve(vertexCount);
+    for (size_t index : settledThisStep) {
+        GlassInstance& glass = glasses[index];
+        const std::vector<FragmentSim>& fragments = glass.core->getFragments();
+        const std::vector<Vertex>& triangles = glass.core->getTemplate()->triangles;
+        for (size_t i = 0; i < fragments.size(); ++i) {
+            glm::mat4 model = glm::translate(glass.transform, fragments[i].position);
+            model = glm::rotate(model, glm::radians(fragments[i].rotationAngle), fragments[i].rotationAxis);
+            glm::mat3 rotation(model);
+            for (size_t k = 0; k < 3; ++k) {
+                const Vertex& v = triangles[i * 3 + k];
+                Vertex baked;
+                baked.Position = glm::vec3(model * glm::vec4(v.Position, 1.0f));
+                baked.Normal = rotation * v.Normal;
+                bakeScratch.push_back(baked);
+            }
         }
+        delete glass.core;
+        glass.core = nullptr;
     }
+    fragmentSetChanged = true;
+    reserveBaked(bakedVertexCount + bakeScratch.size());
+    glState.bindBuffer(GL_ARRAY_BUFFER, bakedVBO);
+    glBufferSubData(GL_ARRAY_BUFFER, bakedVertexCount * sizeof(Vertex), bakeScratch.size() * sizeof(Vertex), bakeScratch.data());
+    bakedVertexCount += bakeScratch.size();
+    logger.addLog("Baked " + std::to_string(settledThisStep.size()) + " settled glass(es), "
+        + std::to_string(bakeScratch.size() / 3) + " fragments, into the static mesh.");
+}
+
+void GlassSimulation::reserveBaked(size_t vertexCount) {
+    if (vertexCount <= bakedVertexCapacity) return;
+    size_t capacity = std::max<size_t>(bakedVertexCapacity * 2, 1 << 16);
+    while (capacity < vertexCount) capacity *= 2;
+    unsigned int buffer;
+    glGenBuffers(1, &buffer);
+    glState.bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, capacity * sizeof(Vertex), nullptr, GL_STATIC_DRAW);
+    if (bakedVertexCount > 0) {
+        glState.bindBuffer(GL_COPY_READ_BUFFER, bakedVBO);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, bakedVertexCount * sizeof(Vertex));
+    }
+    glState.deleteBuffers(1, &bakedVBO);
+    bakedVBO = buffer;
+    bakedVertexCapacity = capacity;
+    if (!bakedVAO) glGenVertexArrays(1, &bakedVAO);
+    glState.bindVertexArray(bakedVAO);
+    glState.bindBuffer(GL_ARRAY_BUFFER, bakedVBO);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+    glState.bindVertexArray(0);
 }
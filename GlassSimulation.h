@@ -1,42 +1,187 @@
 // GlassSimulation.h
 #pragma once
+#include "CommandBuffer.h"
+#include "GpuParticleSystem.h"
 #include "Model.h"
 #include "Shader.h"
+#include "ParticleSystem.h"
+#include "SimulationCore.h"
+#include "SimulationRecording.h"
+#include "Trajectory.h"
+#include "Culling.h"
+#include "HiZCuller.h"
+#include "OitRenderer.h"
+#include "RadixSort.h"
 #include <glm/glm.hpp>
+#include <map>
+#include <string>
 #include <vector>
 
-struct FragmentSim {
-    glm::vec3 position;
-    glm::vec3 velocity;
-    glm::vec3 rotationAxis;
-    float rotationAngle;
-    float angularVelocity;
-    Mesh* mesh;
+// One glass of the scene. Its core runs in glass-local space (dropping onto y = 0 at the origin)
+// and transform places that space in the world.
+struct GlassInstance {
+    SimulationCore* core;   // null once the settled shards have been baked into the static mesh
+    glm::mat4 transform;
+    glm::quat rotation;     // rotation part of transform (a yaw)
+    int lod;    // fracture level chosen while falling: areaThreshold = base * 4^lod
 };
 
+// Renders and drives a scene of glasses that share one loaded Model and its fracture templates; all
+// physics lives in the headless cores. Every core is stepped in one pass, and a frame is two
+// instanced draws: the glasses still falling and every fragment of every shattered glass.
+// Record/replay and trajectory capture follow the first glass.
 class GlassSimulation {
 public:
     GlassSimulation();
     ~GlassSimulation();
     void update(float dt);
-    void render(const glm::mat4& view, const glm::mat4& projection);
+    // A frame is beginFrame() on the GL thread, recordCommands() on any thread (not concurrently with
+    // update()), then submit() on the GL thread once the buffer is sorted. Uploads recorded
+    // point into this object's instance arrays, which stay untouched until the next recordCommands().
+    void beginFrame();
+    void recordCommands(CommandBuffer& commands, const glm::mat4& view, const glm::mat4& projection);
+    void submit(const CommandBuffer& commands, const glm::mat4& view, const glm::mat4& projection);
     void resetSimulation();
+    // Shared pool that receives the glass dust burst on impact (not owned)
+    void setParticleSystem(ParticleSystem* particles);
+    // Transform feedback pool used instead while gpuDust is set (not owned)
+    void setGpuParticleSystem(GpuParticleSystem* particles) {
+        gpuDustParticles = particles;
+        dustSites.reserve(GpuParticleSystem::kMaxSpawnSites);
+    }
+    // Record/replay: a recording restarts the run with a fresh seed and captures every dt
+    void startRecording();
+    bool stopRecording(const std::string& path);
+    bool startReplay(const std::string& path);
+    bool verifyRecording(const std::string& path);
+    bool isRecording() const { return recording; }
+    bool isReplaying() const { return replaying; }
+    // Trajectory playback: re-watch the last shatter (kept in memory) or a mapped .gstj file
+    bool openTrajectory(const std::string& path);
+    void startPlayback();
+    void stopPlayback();
+    bool isPlayingBack() const { return playbackActive; }
+    void drawPlaybackControls();
+    size_t getGlassCount() const { return glasses.size(); }
+    size_t getFragmentCount() const;    // simulated plus baked
+    size_t getBakedFragmentCount() const { return bakedVertexCount / 3; }
     float fallHeight;   // Starting height of the glass
     float impactAngle;  // Controls fragment dispersion
+    int dustCount;      // Dust particles emitted from the fracture sites of each glass
+    bool gpuDust;       // Emit the dust on the GPU pool instead: no CPU cost per particle
+    bool captureTrajectory; // Write the shatter trajectory to trajectory.gstj instead of keeping it in memory
+    int glassCount;     // Glasses spawned by the next reset, laid out on a square grid
+    float glassSpacing; // Grid pitch between glasses
+    float heightJitter; // Glasses after the first drop from fallHeight * (1 +- heightJitter)
+    // Fracture LOD: each falling glass gets the finest level whose fragments still cover
+    // minFragmentPixels on screen, then the smallest glasses are coarsened until the projected
+    // total fits fragmentBudget. Each level has ~1/4 the fragments of the one before.
+    bool adaptiveLod;
+    int fragmentBudget;
+    float minFragmentPixels;
+    static constexpr int kMaxFractureLod = 4;
+    bool bakeSettled;   // Merge settled glasses into one static mesh and free their cores
+    bool frustumCulling;
+    bool occlusionCulling;  // Test against the Hi-Z pyramid of an earlier frame's opaque depth (the floor)
+    bool orderIndependent;  // Weighted blended OIT for glass and fragments instead of draw-order blending
+    bool depthSort;         // Without OIT: draw fragments back to front (parallel radix sort on view depth)
+    size_t getDrawnFragmentCount() const { return drawnFragments; }
+    size_t getLiveFragmentCount() const { return fragmentRefs.size(); }
+    // Logs key build + sort + instance gather time at 10k..1M synthetic fragments
+    void benchmarkDepthSort();
 private:
-    enum class State { FALLING, SHATTERED, SIMULATION_DONE };
-    State state;
-    float simulationTime;
-    glm::vec3 glassPosition;
-    glm::vec3 glassVelocity;
+    // Per-fragment instance: world transform and the fragment's first texel in the triangle buffer
+    struct FragmentInstance {
+        InstanceTransform transform;
+        uint32_t triangle;
+    };
     Model* glassModel;
-    Shader* glassShader;
-    std::vector<FragmentSim> fragments;
+    // Specializations of shaders/glass.vert + glass.frag, by draw and by OIT on/off
+    enum class GlassDraw { Falling, Fragments, Baked, Count };
+    Shader* glassVariants[static_cast<int>(GlassDraw::Count)][2];
+    Shader& getGlassShader(GlassDraw draw, bool oit);
+    OitRenderer* oit;
+    FractureTemplateCache* templates;
+    std::vector<GlassInstance> glasses;
+    std::vector<size_t> shatteredThisStep;
+    ParticleSystem* dustParticles;
+    GpuParticleSystem* gpuDustParticles;
+    std::vector<Particle> dustBatch;    // scratch for the impact burst, reused between shatters
+    std::vector<glm::vec3> dustSites;   // same, fracture sites handed to the GPU pool
+    bool recording;
+    bool replaying;
+    size_t replayFrame;
+    SimulationRecording record;
+    TrajectoryWriter trajectoryWriter;
+    TrajectoryReader playbackReader;
+    std::vector<FragmentPose> playbackPoses;
+    bool playbackActive;
+    bool playbackPaused;
+    size_t playbackFrame;
+    float playbackClock;
+    float playbackSpeed;
+    // Fragment geometry for instanced drawing: every template in use (and the playback trajectory's
+    // triangles) concatenated into one texture buffer, two RGBA32F texels (position, normal) per vertex
+    std::vector<glm::vec4> triangleTexels;
+    std::map<const std::vector<Vertex>*, uint32_t> triangleBase;   // template geometry -> first fragment
+    bool trianglesDirty;
+    unsigned int triangleBuffer, triangleTexture;
+    GLint maxTriangleTexels;
+    std::vector<InstanceTransform> glassInstances;
+    std::vector<FragmentInstance> fragmentInstances;
+    unsigned int glassInstanceVBO, fragmentVAO, fragmentInstanceVBO;
+    size_t lodFragments[kMaxFractureLod + 1];   // template fragment count per LOD level
+    glm::vec3 modelCenter;
+    float modelRadius;
+    float viewportHeight;
+    int frameWidth, frameHeight;    // viewport at beginFrame()
+    bool frameOit;      // this frame records the OIT shader variants
+    std::vector<std::pair<float, size_t>> lodOrder;    // (projected size, glass), reused every step
+    float lodThreshold(int lod) const;
+    void initFractureLod();
+    void chooseFractureLod();
+    void finishTrajectory();
+    void advancePlayback(float dt);
+    void spawnGlasses(uint32_t seed);
+    void clearGlasses();
+    void onShatter(size_t glass);
+    void emitDust(const GlassInstance& glass);
+    uint32_t getTriangleBase(const std::vector<Vertex>& triangles);
+    void clearTriangles();
+    void initInstancing();
+    void addFragmentInstance(const GlassInstance& glass, uint32_t triangle, const glm::vec3& position,
+        float rotationAngle, const glm::vec3& rotationAxis);
+    void recordFragments(CommandBuffer& commands, const glm::mat4& view, const glm::mat4& projection, uint16_t order);
+    RadixSorter* depthSorter;
+    std::vector<uint32_t> sortKeys, sortOrder;
+    std::vector<FragmentInstance> sortedInstances;
+    void sortFragmentsByDepth(const glm::mat4& view);
+    // Live (shattered, not yet baked) fragments of every glass in one BVH, refit every step
+    struct FragmentRef {
+        uint32_t glass;
+        uint32_t fragment;
+    };
+    std::vector<FragmentRef> fragmentRefs;
+    std::vector<BoundingSphere> fragmentSpheres;
+    SphereBvh fragmentBvh;
+    HiZCuller* hiZ;
+    bool fragmentSetChanged;
+    std::vector<uint32_t> visibleFragments;
+    std::vector<uint32_t> glassTriangleBase;
+    size_t drawnFragments;
+    size_t frustumCulled, occlusionCulled;
+    void updateFragmentBounds();
+    // Settled shards in world space, appended in place; grown by doubling with a GPU-side copy so
+    // no CPU copy of the baked geometry is kept
+    unsigned int bakedVAO, bakedVBO;
+    size_t bakedVertexCount;
+    size_t bakedVertexCapacity;
+    std::vector<size_t> settledThisStep;
+    std::vector<Vertex> bakeScratch;
+    bool canBake(size_t glass) const;
+    void bakeSettledGlasses();
+    void reserveBaked(size_t vertexCount);
     unsigned int planeVAO, planeVBO;
     Shader* planeShader;
     void initPlane();
-    void renderPlane(const glm::mat4& view, const glm::mat4& projection);
-    const float gravity = 9.81f;
-    const float restitution = 0.5f;
-    const float friction = 0.8f;
 };
@@ -2,6 +2,8 @@
 #include "Globals.h"
 Camera camera;
 Logger logger;
+Profiler profiler;
+TraceRecorder tracer;
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 bool mouseCaptured = true;
@@ -2,8 +2,12 @@
 #pragma once
 #include "Camera.h"
 #include "Logger.h"
+#include "Profiler.h"
+#include "Trace.h"
 extern Camera camera;
 extern Logger logger;
+extern Profiler profiler;
+extern TraceRecorder tracer;
 extern float deltaTime;
 extern float lastFrame;
 extern bool mouseCaptured;
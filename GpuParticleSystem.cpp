@@ -0,0 +1,156 @@
+// GpuParticleSystem.cpp
+#include "GpuParticleSystem.h"
+#include "GlState.h"
+#include "Globals.h"
+#include "Logger.h"
+#include <glad/glad.h>
+#include <algorithm>
+
+// Interleaved layout shared by the update and render VAOs: position, velocity, life
+static const int kFloatsPerParticle = 7;
+
+GpuParticleSystem::GpuParticleSystem(unsigned int capacity)
+    : pointSize(0.05f), capacity(std::max(capacity, 1u)), head(0), current(0), spawnSeed(1)
+{
+    timeSinceEmit = lifetime;
+    const char* varyings[] = { "outPosition", "outVelocity", "outLife" };
+    updateShader = new Shader();
+    updateShader->ID = loadTransformFeedbackShader("shaders/particle_update.vert", varyings, 3);
+    if (!updateShader->ID) {
+        logger.addLog(LogLevel::Error, "Failed to load particle update shader.");
+    }
+    renderShader = new Shader("shaders/particle_point.vert", "shaders/particle.frag");
+    if (!renderShader->ID) {
+        logger.addLog(LogLevel::Error, "Failed to load particle point shader.");
+    }
+    initBuffers();
+}
+
+GpuParticleSystem::~GpuParticleSystem() {
+    delete updateShader;
+    delete renderShader;
+    glState.deleteVertexArrays(2, updateVAOs);
+    glState.deleteVertexArrays(2, renderVAOs);
+    glState.deleteBuffers(2, buffers);
+}
+
+void GpuParticleSystem::initBuffers() {
+    // Zeroed state means every slot starts dead (life == 0)
+    std::vector<float> zeroes(static_cast<size_t>(capacity) * kFloatsPerParticle, 0.0f);
+    GLsizei stride = kFloatsPerParticle * sizeof(float);
+    glGenBuffers(2, buffers);
+    glGenVertexArrays(2, updateVAOs);
+    glGenVertexArrays(2, renderVAOs);
+    for (int i = 0; i < 2; ++i) {
+        glState.bindBuffer(GL_ARRAY_BUFFER, buffers[i]);
+        glBufferData(GL_ARRAY_BUFFER, zeroes.size() * sizeof(float), zeroes.data(), GL_DYNAMIC_COPY);
+
+        glState.bindVertexArray(updateVAOs[i]);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
+
+        // Rendering only needs position and life
+        glState.bindVertexArray(renderVAOs[i]);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
+    }
+    glState.bindVertexArray(0);
+    glState.bindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void GpuParticleSystem::emit(const glm::vec3* sites, size_t siteCount, float impactAngle, unsigned int count) {
+    count = std::min(count, capacity);
+    siteCount = std::min(siteCount, kMaxSpawnSites);
+    if (count == 0 || siteCount == 0) return;
+    Spawn spawn;
+    std::copy(sites, sites + siteCount, spawn.sites);
+    spawn.siteCount = static_cast<unsigned int>(siteCount);
+    spawn.impactAngle = impactAngle;
+    spawn.start = head;
+    spawn.count = count;
+    spawn.seed = spawnSeed++;
+    pendingSpawns.push_back(spawn);
+    head = (head + count) % capacity;
+    timeSinceEmit = 0.0f;
+}
+
+void GpuParticleSystem::simulate(float dt, const Spawn* spawn) {
+    unsigned int ID = updateShader->ID;
+    glUniform1f(glGetUniformLocation(ID, "dt"), dt);
+    glUniform1ui(glGetUniformLocation(ID, "spawnCount"), spawn ? spawn->count : 0u);
+    if (spawn) {
+        glUniform1ui(glGetUniformLocation(ID, "spawnStart"), spawn->start);
+        glUniform1ui(glGetUniformLocation(ID, "seed"), spawn->seed);
+        glUniform1ui(glGetUniformLocation(ID, "siteCount"), spawn->siteCount);
+        glUniform3fv(glGetUniformLocation(ID, "spawnSites"), spawn->siteCount, &spawn->sites[0][0]);
+        glUniform1f(glGetUniformLocation(ID, "impactAngle"), spawn->impactAngle);
+    }
+    unsigned int next = 1 - current;
+    glState.bindVertexArray(updateVAOs[current]);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, buffers[next]);
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, capacity);
+    glEndTransformFeedback();
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    current = next;
+}
+
+void GpuParticleSystem::update(float dt) {
+    if (isFinished() && pendingSpawns.empty()) return;
+    timeSinceEmit += dt;
+    glState.useProgram(updateShader->ID);
+    glUniform1f(glGetUniformLocation(updateShader->ID, "gravity"), gravity);
+    glUniform1ui(glGetUniformLocation(updateShader->ID, "capacity"), capacity);
+    glUniform1f(glGetUniformLocation(updateShader->ID, "lifetime"), lifetime);
+    glState.setEnabled(GL_RASTERIZER_DISCARD, true);
+    if (pendingSpawns.empty()) {
+        simulate(dt, nullptr);
+    }
+    else {
+        // One pass per spawn; only the last one advances time
+        for (size_t i = 0; i < pendingSpawns.size(); ++i) {
+            bool last = i + 1 == pendingSpawns.size();
+            simulate(last ? dt : 0.0f, &pendingSpawns[i]);
+        }
+        pendingSpawns.clear();
+    }
+    glState.setEnabled(GL_RASTERIZER_DISCARD, false);
+}
+
+void GpuParticleSystem::render(const glm::mat4& view, const glm::mat4& projection) {
+    if (isFinished()) return;
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glState.useProgram(renderShader->ID);
+    glUniformMatrix4fv(glGetUniformLocation(renderShader->ID, "view"), 1, GL_FALSE, &view[0][0]);
+    glUniformMatrix4fv(glGetUniformLocation(renderShader->ID, "projection"), 1, GL_FALSE, &projection[0][0]);
+    glUniform1f(glGetUniformLocation(renderShader->ID, "pointSize"), pointSize);
+    glUniform1f(glGetUniformLocation(renderShader->ID, "viewportHeight"), static_cast<float>(viewport[3]));
+    glState.setEnabled(GL_PROGRAM_POINT_SIZE, true);
+    glState.bindVertexArray(renderVAOs[current]);
+    glDrawArrays(GL_POINTS, 0, capacity);
+    glState.setEnabled(GL_PROGRAM_POINT_SIZE, false);
+}
+
+bool GpuParticleSystem::isFinished() const {
+    // Every particle gets the same lifetime, so nothing is alive once it has elapsed
+    return timeSinceEmit >= lifetime;
+}
+
+void GpuParticleSystem::reset() {
+    pendingSpawns.clear();
+    head = 0;
+    timeSinceEmit = lifetime;
+    std::vector<float> zeroes(static_cast<size_t>(capacity) * kFloatsPerParticle, 0.0f);
+    for (int i = 0; i < 2; ++i) {
+        glState.bindBuffer(GL_ARRAY_BUFFER, buffers[i]);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, zeroes.size() * sizeof(float), zeroes.data());
+    }
+    glState.bindBuffer(GL_ARRAY_BUFFER, 0);
+}
@@ -0,0 +1,46 @@
+// GpuParticleSystem.h
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#include "Shader.h"
+
+// Particle state lives in two VBOs that are ping-ponged through transform feedback,
+// so simulation and rendering never touch particle data on the CPU (GL 3.3 core).
+class GpuParticleSystem {
+public:
+    explicit GpuParticleSystem(unsigned int capacity);
+    ~GpuParticleSystem();
+    // Each particle starts at one of the sites, picked at random; sites past kMaxSpawnSites are ignored
+    void emit(const glm::vec3* sites, size_t siteCount, float impactAngle, unsigned int count);
+    void update(float dt);
+    void render(const glm::mat4& view, const glm::mat4& projection);
+    bool isFinished() const;
+    void reset();
+    unsigned int getCapacity() const { return capacity; }
+    float pointSize;
+    static const size_t kMaxSpawnSites = 64;   // uniform array in particle_update.vert
+private:
+    struct Spawn {
+        glm::vec3 sites[kMaxSpawnSites];
+        unsigned int siteCount;
+        float impactAngle;
+        unsigned int start;
+        unsigned int count;
+        unsigned int seed;
+    };
+    unsigned int capacity;
+    unsigned int head;          // next slot handed out by emit, wraps around
+    unsigned int current;       // buffer holding the latest state
+    unsigned int buffers[2];
+    unsigned int updateVAOs[2];
+    unsigned int renderVAOs[2];
+    Shader* updateShader;
+    Shader* renderShader;
+    std::vector<Spawn> pendingSpawns;
+    unsigned int spawnSeed;
+    float timeSinceEmit;
+    const float lifetime = 3.0f;
+    const float gravity = 9.81f;
+    void initBuffers();
+    void simulate(float dt, const Spawn* spawn);
+};
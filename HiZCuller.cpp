@@ -0,0 +1,225 @@
+// HiZCuller.cpp
+#include "HiZCuller.h"
+#include "GlState.h"
+#include "Globals.h"
+#include <glad/glad.h>
+#include <algorithm>
+#include <cmath>
+
+HiZCuller::HiZCuller()
+    : emptyVAO(0), depthFBO(0), depthTexture(0), reduceFBO(0), reduceTexture(0), depthWidth(0), depthHeight(0),
+      baseWidth(0), baseHeight(0), nextReadback(0), failed(false), ready(false), pyramidViewProjection(1.0f)
+{
+    reduceShader = new Shader("shaders/fullscreen.vert", "shaders/hiz_reduce.frag");
+    if (!reduceShader->ID) {
+        logger.addLog(LogLevel::Error, "Failed to load Hi-Z reduce shader, occlusion culling disabled.");
+        failed = true;
+    }
+    glGenVertexArrays(1, &emptyVAO);
+    for (auto& readback : readbacks) {
+        glGenBuffers(1, &readback.pbo);
+    }
+}
+
+HiZCuller::~HiZCuller() {
+    for (auto& readback : readbacks) {
+        if (readback.fence) glDeleteSync(static_cast<GLsync>(readback.fence));
+        glState.deleteBuffers(1, &readback.pbo);
+    }
+    glState.deleteFramebuffers(1, &depthFBO);
+    glState.deleteTextures(1, &depthTexture);
+    glState.deleteFramebuffers(1, &reduceFBO);
+    glState.deleteTextures(1, &reduceTexture);
+    glState.deleteVertexArrays(1, &emptyVAO);
+    delete reduceShader;
+}
+
+// (Re)creates the depth copy and the reduced target when the window size changes
+bool HiZCuller::ensureTargets(int width, int height) {
+    if (width == depthWidth && height == depthHeight) return true;
+    depthWidth = width;
+    depthHeight = height;
+    baseWidth = std::min(kBaseWidth, width);
+    baseHeight = std::max(1, height * baseWidth / width);
+    if (!depthFBO) {
+        glGenFramebuffers(1, &depthFBO);
+        glGenTextures(1, &depthTexture);
+        glGenFramebuffers(1, &reduceFBO);
+        glGenTextures(1, &reduceTexture);
+    }
+    // Depth blits need an identical format; GLFW's default framebuffer is D24S8
+    glState.bindTexture(GL_TEXTURE_2D, depthTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, width, height, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glState.bindFramebuffer(GL_FRAMEBUFFER, depthFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glState.bindTexture(GL_TEXTURE_2D, reduceTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, baseWidth, baseHeight, 0, GL_RED, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glState.bindFramebuffer(GL_FRAMEBUFFER, reduceFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, reduceTexture, 0);
+    complete = complete && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
+    glState.bindTexture(GL_TEXTURE_2D, 0);
+    for (auto& readback : readbacks) {
+        // Reallocating orphans anything still in flight
+        if (readback.fence) glDeleteSync(static_cast<GLsync>(readback.fence));
+        readback.fence = nullptr;
+        glState.bindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, baseWidth * baseHeight * sizeof(float), nullptr, GL_STREAM_READ);
+    }
+    glState.bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (!complete) {
+        logger.addLog(LogLevel::Error, "Hi-Z framebuffers incomplete, occlusion culling disabled.");
+        failed = true;
+    }
+    return complete;
+}
+
+void HiZCuller::captureDepth(int width, int height, const glm::mat4& viewProjection) {
+    if (failed || width <= 0 || height <= 0) return;
+    Readback& readback = readbacks[nextReadback];
+    // Every readback still in flight: skip a capture rather than wait on the GPU
+    if (readback.fence) return;
+    PROFILE_SCOPE("hiZ.capture");
+    if (!ensureTargets(width, height)) return;
+    GLuint previousFBO = glState.getFramebuffer(GL_FRAMEBUFFER);
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    bool depthTest = glState.isEnabled(GL_DEPTH_TEST);
+    bool blend = glState.isEnabled(GL_BLEND);
+
+    while (glGetError() != GL_NO_ERROR) {}
+    glState.bindFramebuffer(GL_READ_FRAMEBUFFER, previousFBO);
+    glState.bindFramebuffer(GL_DRAW_FRAMEBUFFER, depthFBO);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    if (glGetError() != GL_NO_ERROR) {
+        logger.addLog(LogLevel::Error, "Depth buffer cannot be copied (format mismatch), occlusion culling disabled.");
+        failed = true;
+        glState.bindFramebuffer(GL_FRAMEBUFFER, previousFBO);
+        return;
+    }
+
+    glState.bindFramebuffer(GL_FRAMEBUFFER, reduceFBO);
+    glViewport(0, 0, baseWidth, baseHeight);
+    glState.setEnabled(GL_DEPTH_TEST, false);
+    glState.setEnabled(GL_BLEND, false);
+    glState.useProgram(reduceShader->ID);
+    glUniform1i(glGetUniformLocation(reduceShader->ID, "depthTexture"), 0);
+    glUniform2i(glGetUniformLocation(reduceShader->ID, "sourceSize"), width, height);
+    glUniform2i(glGetUniformLocation(reduceShader->ID, "targetSize"), baseWidth, baseHeight);
+    glState.activeTexture(GL_TEXTURE0);
+    glState.bindTexture(GL_TEXTURE_2D, depthTexture);
+    glState.bindVertexArray(emptyVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    // Into the PBO: glReadPixels returns immediately, the fence says when the copy has landed
+    glState.bindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+    glReadPixels(0, 0, baseWidth, baseHeight, GL_RED, GL_FLOAT, nullptr);
+    glState.bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    readback.viewProjection = viewProjection;
+    readback.width = baseWidth;
+    readback.height = baseHeight;
+    nextReadback = (nextReadback + 1) % kReadbacks;
+
+    glState.bindFramebuffer(GL_FRAMEBUFFER, previousFBO);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    if (depthTest) glState.setEnabled(GL_DEPTH_TEST, true);
+    if (blend) glState.setEnabled(GL_BLEND, true);
+}
+
+void HiZCuller::beginFrame() {
+    if (failed) return;
+    // Readbacks finish in submission order, starting from the oldest slot; only the newest
+    // finished one is worth building a pyramid from
+    Readback* newest = nullptr;
+    for (int i = 0; i < kReadbacks; ++i) {
+        Readback& readback = readbacks[(nextReadback + i) % kReadbacks];
+        if (!readback.fence) continue;
+        GLenum status = glClientWaitSync(static_cast<GLsync>(readback.fence), 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+        glDeleteSync(static_cast<GLsync>(readback.fence));
+        readback.fence = nullptr;
+        newest = &readback;
+    }
+    if (!newest) return;
+    glState.bindBuffer(GL_PIXEL_PACK_BUFFER, newest->pbo);
+    const float* data = static_cast<const float*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+        newest->width * newest->height * sizeof(float), GL_MAP_READ_BIT));
+    if (data) {
+        buildPyramid(data, newest->width, newest->height);
+        pyramidViewProjection = newest->viewProjection;
+        ready = true;
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glState.bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+// Max-reduce down to 1x1; odd edges fold into the last texel so every level stays conservative
+void HiZCuller::buildPyramid(const float* base, int width, int height) {
+    PROFILE_SCOPE("hiZ.pyramid");
+    int levelCount = 1;
+    for (int w = width, h = height; w > 1 || h > 1; w = (w + 1) / 2, h = (h + 1) / 2) levelCount++;
+    levels.resize(levelCount);
+    levels[0].width = width;
+    levels[0].height = height;
+    levels[0].depth.assign(base, base + width * height);
+    for (int l = 1; l < levelCount; ++l) {
+        const Level& src = levels[l - 1];
+        Level& dst = levels[l];
+        dst.width = (src.width + 1) / 2;
+        dst.height = (src.height + 1) / 2;
+        dst.depth.resize(dst.width * dst.height);
+        for (int y = 0; y < dst.height; ++y) {
+            int y0 = y * 2, y1 = std::min(y * 2 + 1, src.height - 1);
+            for (int x = 0; x < dst.width; ++x) {
+                int x0 = x * 2, x1 = std::min(x * 2 + 1, src.width - 1);
+                dst.depth[y * dst.width + x] = std::max(
+                    std::max(src.depth[y0 * src.width + x0], src.depth[y0 * src.width + x1]),
+                    std::max(src.depth[y1 * src.width + x0], src.depth[y1 * src.width + x1]));
+            }
+        }
+    }
+}
+
+bool HiZCuller::isVisible(const BoundingSphere& sphere) const {
+    if (!ready) return true;
+    // Screen rectangle and nearest depth of the sphere's bounding box in the captured view
+    glm::vec3 lo(1e30f), hi(-1e30f);
+    for (int corner = 0; corner < 8; ++corner) {
+        glm::vec3 offset((corner & 1) ? sphere.radius : -sphere.radius, (corner & 2) ? sphere.radius : -sphere.radius,
+            (corner & 4) ? sphere.radius : -sphere.radius);
+        glm::vec4 clip = pyramidViewProjection * glm::vec4(sphere.center + offset, 1.0f);
+        // Reaches behind the camera: the projection is meaningless, keep it
+        if (clip.w <= 1e-4f) return true;
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        lo = glm::min(lo, ndc);
+        hi = glm::max(hi, ndc);
+    }
+    // Outside the captured view there is no depth to test against
+    if (hi.x < -1.0f || lo.x > 1.0f || hi.y < -1.0f || lo.y > 1.0f) return true;
+    float nearestDepth = lo.z * 0.5f + 0.5f;
+    const Level& base = levels[0];
+    int x0 = std::max(0, static_cast<int>((lo.x * 0.5f + 0.5f) * base.width));
+    int x1 = std::min(base.width - 1, static_cast<int>((hi.x * 0.5f + 0.5f) * base.width));
+    int y0 = std::max(0, static_cast<int>((lo.y * 0.5f + 0.5f) * base.height));
+    int y1 = std::min(base.height - 1, static_cast<int>((hi.y * 0.5f + 0.5f) * base.height));
+    // Coarsest detail needed: the level where the rectangle spans at most 2x2 texels
+    int level = 0;
+    while (level + 1 < static_cast<int>(levels.size()) && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1))
+        level++;
+    const Level& l = levels[level];
+    float farthest = 0.0f;
+    for (int y = y0 >> level; y <= std::min(y1 >> level, l.height - 1); ++y) {
+        for (int x = x0 >> level; x <= std::min(x1 >> level, l.width - 1); ++x) {
+            farthest = std::max(farthest, l.depth[y * l.width + x]);
+        }
+    }
+    return nearestDepth <= farthest;
+}
@@ -0,0 +1,53 @@
+// HiZCuller.h
+#pragma once
+#include "Culling.h"
+#include "Shader.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+// Occlusion culling against a hierarchical-Z pyramid of an earlier frame's depth buffer.
+// captureDepth() copies the depth buffer, reduces it on the GPU to a small max-depth target and
+// reads that back through a PBO without stalling; a later frame picks the result up, builds the
+// rest of the pyramid on the CPU and tests bounding spheres with the view-projection the depth
+// was rendered with. Geometry that moved into view since then can be culled for a frame or two.
+class HiZCuller {
+public:
+    HiZCuller();
+    ~HiZCuller();
+    // Call after the opaque passes and before anything translucent is drawn, on the GL thread
+    void captureDepth(int width, int height, const glm::mat4& viewProjection);
+    // Adopts the newest finished readback; call once per frame before testing
+    void beginFrame();
+    bool isReady() const { return ready; }
+    // False only when the sphere is certainly behind the captured depth
+    bool isVisible(const BoundingSphere& sphere) const;
+    static constexpr int kBaseWidth = 160;  // width of the GPU-reduced level read back
+private:
+    struct Level {
+        int width;
+        int height;
+        std::vector<float> depth;   // max depth per texel, row 0 at the bottom
+    };
+    static constexpr int kReadbacks = 3;
+    struct Readback {
+        unsigned int pbo = 0;
+        void* fence = nullptr;  // GLsync
+        glm::mat4 viewProjection;
+        int width = 0;
+        int height = 0;
+    };
+    Shader* reduceShader;
+    unsigned int emptyVAO;
+    unsigned int depthFBO, depthTexture;
+    unsigned int reduceFBO, reduceTexture;
+    int depthWidth, depthHeight;
+    int baseWidth, baseHeight;
+    Readback readbacks[kReadbacks];
+    int nextReadback;
+    bool failed;
+    bool ready;
+    glm::mat4 pyramidViewProjection;
+    std::vector<Level> levels;
+    bool ensureTargets(int width, int height);
+    void buildPyramid(const float* base, int width, int height);
+};
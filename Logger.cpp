@@ -1,16 +1,200 @@
 // Logger.cpp
 #include "Logger.h"
 #include "imgui.h"
+#include <cstdio>
+#include <cstdint>
+#include <algorithm>
+
+Logger::Logger()
+    : queue(new Slot[kQueueSize]), enqueuePos(0), dequeuePos(0), dropped(0), history(kHistorySize),
+      historyHead(0), historyCount(0), autoScroll(true), start(std::chrono::steady_clock::now()),
+      sinkRunning(false), sinkPending(0), sinkMaxBytes(0), sinkMaxFiles(0), sinkEcho(false)
+{
+    for (size_t i = 0; i < kQueueSize; ++i)
+        queue[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+Logger::~Logger() {
+    stopFileSink();
+}
+
 void Logger::addLog(const std::string& log) {
-    logs.push_back(log);
+    addLog(LogLevel::Info, log);
+}
+
+void Logger::addLog(LogLevel level, const std::string& log) {
+    double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    // Bounded MPSC queue (Vyukov): claim a slot by CAS on the enqueue position
+    size_t pos = enqueuePos.load(std::memory_order_relaxed);
+    Slot* slot;
+    for (;;) {
+        slot = &queue[pos & (kQueueSize - 1)];
+        size_t seq = slot->sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+        if (diff == 0) {
+            if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0) {
+            // Full: drop rather than block the caller
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        else {
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+    slot->entry.time = time;
+    slot->entry.level = level;
+    slot->entry.text.assign(log);
+    slot->sequence.store(pos + 1, std::memory_order_release);
+}
+
+void Logger::collect() {
+    std::lock_guard<std::mutex> lock(historyMutex);
+    for (;;) {
+        Slot& slot = queue[dequeuePos & (kQueueSize - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != dequeuePos + 1) break;
+        // Swap so both the history entry and the slot keep their string capacity
+        LogEntry& target = history[(historyHead + historyCount) % kHistorySize];
+        std::swap(target, slot.entry);
+        if (historyCount < kHistorySize) historyCount++;
+        else historyHead = (historyHead + 1) % kHistorySize;
+        if (sinkPending < kHistorySize) sinkPending++;
+        slot.sequence.store(dequeuePos + kQueueSize, std::memory_order_release);
+        dequeuePos++;
+    }
+}
+
+const char* Logger::levelName(LogLevel level) {
+    switch (level) {
+    case LogLevel::Warning: return "WARN";
+    case LogLevel::Error: return "ERROR";
+    default: return "INFO";
+    }
 }
+
 void Logger::draw(const std::string& title) {
+    collect();
     ImGui::Begin(title.c_str());
-    for (auto& log : logs) {
-        ImGui::TextUnformatted(log.c_str());
+    ImGui::Checkbox("Auto-scroll", &autoScroll);
+    size_t droppedCount = dropped.load(std::memory_order_relaxed);
+    if (droppedCount) {
+        ImGui::SameLine();
+        ImGui::Text("(%zu dropped)", droppedCount);
+    }
+    ImGui::BeginChild("LogLines");
+    std::lock_guard<std::mutex> lock(historyMutex);
+    // Only the visible lines are formatted and submitted
+    ImGuiListClipper clipper;
+    clipper.Begin(static_cast<int>(historyCount));
+    while (clipper.Step()) {
+        for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; ++i) {
+            const LogEntry& entry = history[(historyHead + i) % kHistorySize];
+            ImVec4 color = entry.level == LogLevel::Error ? ImVec4(1.0f, 0.4f, 0.4f, 1.0f)
+                : entry.level == LogLevel::Warning ? ImVec4(1.0f, 0.8f, 0.3f, 1.0f)
+                : ImGui::GetStyleColorVec4(ImGuiCol_Text);
+            ImGui::TextColored(color, "[%8.3f] [%s] %s", entry.time, levelName(entry.level), entry.text.c_str());
+        }
     }
+    if (autoScroll && ImGui::GetScrollY() >= ImGui::GetScrollMaxY())
+        ImGui::SetScrollHereY(1.0f);
+    ImGui::EndChild();
     ImGui::End();
 }
 
+bool Logger::startFileSink(const std::string& path, size_t maxBytes, int maxFiles, bool echoStdout) {
+    stopFileSink();
+    sinkPath = path;
+    sinkMaxBytes = maxBytes;
+    sinkMaxFiles = maxFiles;
+    sinkEcho = echoStdout;
+    FILE* file = sinkMaxFiles > 1 ? rotate(nullptr) : fopen(sinkPath.c_str(), "w");
+    if (!file) {
+        addLog(LogLevel::Error, "Failed to open log file: " + path);
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(historyMutex);
+        // Include whatever was logged before the sink started
+        sinkPending = historyCount;
+    }
+    sinkRunning = true;
+    sinkThread = std::thread(&Logger::sinkLoop, this, file);
+    return true;
+}
+
+void Logger::stopFileSink() {
+    {
+        std::lock_guard<std::mutex> lock(sinkMutex);
+        if (!sinkRunning) return;
+        sinkRunning = false;
+    }
+    sinkWake.notify_one();
+    if (sinkThread.joinable()) sinkThread.join();
+}
+
+void Logger::drainForSink(std::vector<LogEntry>& batch) {
+    collect();
+    std::lock_guard<std::mutex> lock(historyMutex);
+    size_t count = std::min(sinkPending, historyCount);
+    batch.resize(count);
+    for (size_t i = 0; i < count; ++i)
+        batch[i] = history[(historyHead + historyCount - count + i) % kHistorySize];
+    sinkPending = 0;
+}
+
+FILE* Logger::rotate(FILE* file) {
+    if (file) fclose(file);
+    // path.(n-1) -> path.n, ..., path -> path.1
+    for (int i = sinkMaxFiles - 1; i >= 1; --i) {
+        std::string from = i == 1 ? sinkPath : sinkPath + "." + std::to_string(i - 1);
+        std::string to = sinkPath + "." + std::to_string(i);
+        std::remove(to.c_str());
+        std::rename(from.c_str(), to.c_str());
+    }
+    return fopen(sinkPath.c_str(), "w");
+}
+
+void Logger::writeBatch(FILE*& file, size_t& fileBytes, const std::vector<LogEntry>& batch, std::string& buffer) {
+    // Formatting happens here, on the writer thread, never in addLog
+    buffer.clear();
+    char prefix[48];
+    for (const auto& entry : batch) {
+        snprintf(prefix, sizeof(prefix), "[%10.3f] [%s] ", entry.time, levelName(entry.level));
+        buffer += prefix;
+        buffer += entry.text;
+        buffer += '\n';
+    }
+    if (buffer.empty()) return;
+    if (sinkEcho) fwrite(buffer.data(), 1, buffer.size(), stdout);
+    if (sinkMaxBytes && fileBytes + buffer.size() > sinkMaxBytes && fileBytes > 0) {
+        file = rotate(file);
+        fileBytes = 0;
+    }
+    if (!file) return;
+    fwrite(buffer.data(), 1, buffer.size(), file);
+    fflush(file);
+    fileBytes += buffer.size();
+}
+
+void Logger::sinkLoop(FILE* file) {
+    size_t fileBytes = 0;
+    std::vector<LogEntry> batch;
+    std::string buffer;
+    bool running = true;
+    while (running) {
+        {
+            // Producers never signal; the writer just wakes up periodically
+            std::unique_lock<std::mutex> lock(sinkMutex);
+            sinkWake.wait_for(lock, std::chrono::milliseconds(50), [this] { return !sinkRunning; });
+            running = sinkRunning;
+        }
+        drainForSink(batch);
+        writeBatch(file, fileBytes, batch, buffer);
+    }
+    if (file) fclose(file);
+}
+
 // made by Piotrixek / Veni
 // https://github.com/Piotrixek
\ No newline at end of file
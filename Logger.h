@@ -1,11 +1,67 @@
 // Logger.h
 #pragma once
+#include <atomic>
+#include <cstdio>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
+
+enum class LogLevel { Info, Warning, Error };
+
+struct LogEntry {
+    double time;        // seconds since the logger was created
+    LogLevel level;
+    std::string text;
+};
+
+// addLog may be called from any thread: messages go through a bounded lock-free MPSC queue
+// and are moved into a fixed-size history by the single consumer (collect, called from draw).
 class Logger {
 public:
+    Logger();
+    ~Logger();
     void addLog(const std::string& log);
+    void addLog(LogLevel level, const std::string& log);
+    void collect();
     void draw(const std::string& title);
+    static const char* levelName(LogLevel level);
+    // Background writer: drains the queue in batches into a size-rotated file (path, path.1, ...).
+    // The first file is opened here; false (and logged) if it cannot be
+    bool startFileSink(const std::string& path, size_t maxBytes, int maxFiles, bool echoStdout);
+    void stopFileSink();
 private:
-    std::vector<std::string> logs;
+    static const size_t kQueueSize = 1024;      // power of two
+    static const size_t kHistorySize = 4096;
+    struct Slot {
+        std::atomic<size_t> sequence;
+        LogEntry entry;
+    };
+    std::unique_ptr<Slot[]> queue;
+    std::atomic<size_t> enqueuePos;
+    size_t dequeuePos;
+    std::atomic<size_t> dropped;
+    std::mutex historyMutex;    // consumer side only, producers never take it
+    std::vector<LogEntry> history;
+    size_t historyHead;
+    size_t historyCount;
+    bool autoScroll;
+    std::chrono::steady_clock::time_point start;
+    // File sink state; everything below is touched by the writer thread only, except the flag
+    std::thread sinkThread;
+    std::mutex sinkMutex;
+    std::condition_variable sinkWake;
+    bool sinkRunning;
+    size_t sinkPending;         // history entries not yet handed to the sink (guarded by historyMutex)
+    std::string sinkPath;
+    size_t sinkMaxBytes;
+    int sinkMaxFiles;
+    bool sinkEcho;
+    void sinkLoop(FILE* file);
+    void drainForSink(std::vector<LogEntry>& batch);
+    void writeBatch(FILE*& file, size_t& fileBytes, const std::vector<LogEntry>& batch, std::string& buffer);
+    FILE* rotate(FILE* file);
 };
@@ -1,11 +1,13 @@
 // Mesh.cpp
 #include "Mesh.h"
+#include "GlState.h"
 #include <glad/glad.h>
+#include <cstddef>
 
-Mesh::Mesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices)
-    : vertices(vertices), indices(indices)
+Mesh::Mesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, bool uploadToGpu)
+    : vertices(vertices), indices(indices), VAO(0), VBO(0), EBO(0)
 {
-    setupMesh();
+    if (uploadToGpu) setupMesh();
 }
 
 void Mesh::setupMesh() {
@@ -13,13 +15,13 @@ void Mesh::setupMesh() {
     glGenBuffers(1, &VBO);
     glGenBuffers(1, &EBO);
 
-    glBindVertexArray(VAO);
+    glState.bindVertexArray(VAO);
 
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glState.bindBuffer(GL_ARRAY_BUFFER, VBO);
     glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex),
         &vertices[0], GL_STATIC_DRAW);
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
         &indices[0], GL_STATIC_DRAW);
 
@@ -31,11 +33,27 @@ void Mesh::setupMesh() {
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
         (void*)offsetof(Vertex, Normal));
 
-    glBindVertexArray(0);
+    glState.bindVertexArray(0);
 }
 
 void Mesh::Draw(Shader& shader) {
-    glBindVertexArray(VAO);
+    glState.bindVertexArray(VAO);
     glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+}
+
+void Mesh::setInstanceBuffer(unsigned int buffer) {
+    glState.bindVertexArray(VAO);
+    glState.bindBuffer(GL_ARRAY_BUFFER, buffer);
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceTransform), (void*)offsetof(InstanceTransform, rotation));
+    glVertexAttribDivisor(2, 1);
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceTransform), (void*)offsetof(InstanceTransform, translation));
+    glVertexAttribDivisor(3, 1);
+    glState.bindVertexArray(0);
+}
+
+void Mesh::DrawInstanced(Shader& shader, unsigned int instanceCount) {
+    glState.bindVertexArray(VAO);
+    glDrawElementsInstanced(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0, instanceCount);
 }
@@ -2,6 +2,7 @@
 #pragma once
 #include <vector>
 #include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
 #include "Shader.h"
 
 struct Vertex {
@@ -9,13 +10,24 @@ struct Vertex {
     glm::vec3 Normal;
 };
 
+// Rigid per-instance transform: the rotation (x, y, z, w as glm stores it) turns positions and
+// normals alike, so shaders need no normal matrix
+struct InstanceTransform {
+    glm::quat rotation;
+    glm::vec3 translation;
+};
+
 class Mesh {
 public:
     std::vector<Vertex> vertices;
     std::vector<unsigned int> indices;
     unsigned int VAO;
-    Mesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices);
+    // uploadToGpu = false keeps the mesh CPU-only (headless simulation, no GL context needed)
+    Mesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, bool uploadToGpu = true);
     void Draw(Shader& shader);
+    // Sources a per-instance InstanceTransform (attribute locations 2-3) from buffer for DrawInstanced
+    void setInstanceBuffer(unsigned int buffer);
+    void DrawInstanced(Shader& shader, unsigned int instanceCount);
 private:
     unsigned int VBO, EBO;
     void setupMesh();
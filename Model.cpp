@@ -1,11 +1,11 @@
 // Model.cpp
 #include "Model.h"
-#include "Logger.h"
+#include "Globals.h"
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
 #include <iostream>
 
-Model::Model(const std::string& path) {
+Model::Model(const std::string& path, bool uploadToGpu) : uploadToGpu(uploadToGpu) {
     loadModel(path);
 }
 
@@ -16,6 +16,7 @@ void Model::Draw(Shader& shader) {
 }
 
 void Model::loadModel(const std::string& path) {
+    TRACE_SCOPE("Model::loadModel");
     Assimp::Importer importer;
     const aiScene* scene = importer.ReadFile(path,
         aiProcess_Triangulate | aiProcess_FlipUVs);
@@ -64,5 +65,5 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene) {
     }
 
     // Materials and textures are omitted for brevity.
-    return Mesh(vertices, indices);
+    return Mesh(vertices, indices, uploadToGpu);
 }
@@ -11,11 +11,13 @@
 
 class Model {
 public:
-    Model(const std::string& path);
+    // uploadToGpu = false loads CPU-side geometry only, for the headless simulation core
+    Model(const std::string& path, bool uploadToGpu = true);
     void Draw(Shader& shader);
-private:
     std::vector<Mesh> meshes;
+private:
     std::string directory;
+    bool uploadToGpu;
     void loadModel(const std::string& path);
     void processNode(aiNode* node, const aiScene* scene);
     Mesh processMesh(aiMesh* mesh, const aiScene* scene);
@@ -0,0 +1,120 @@
+// OitRenderer.cpp
+#include "OitRenderer.h"
+#include "GlState.h"
+#include "Globals.h"
+#include <glad/glad.h>
+
+OitRenderer::OitRenderer()
+    : emptyVAO(0), fbo(0), accumTexture(0), weightTexture(0), depthTexture(0), targetWidth(0), targetHeight(0),
+      previousFBO(0), failed(false)
+{
+    compositeShader = new Shader("shaders/fullscreen.vert", "shaders/oit_composite.frag");
+    if (!compositeShader->ID) {
+        logger.addLog(LogLevel::Error, "Failed to load OIT composite shader, falling back to plain blending.");
+        failed = true;
+    }
+    glGenVertexArrays(1, &emptyVAO);
+}
+
+OitRenderer::~OitRenderer() {
+    glState.deleteFramebuffers(1, &fbo);
+    glState.deleteTextures(1, &accumTexture);
+    glState.deleteTextures(1, &weightTexture);
+    glState.deleteTextures(1, &depthTexture);
+    glState.deleteVertexArrays(1, &emptyVAO);
+    delete compositeShader;
+}
+
+static void allocateTarget(unsigned int texture, GLint internalFormat, GLenum format, GLenum type, int width, int height) {
+    glState.bindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+}
+
+// (Re)creates the targets when the window size changes
+bool OitRenderer::ensureTargets(int width, int height) {
+    if (width == targetWidth && height == targetHeight) return true;
+    targetWidth = width;
+    targetHeight = height;
+    if (!fbo) {
+        glGenFramebuffers(1, &fbo);
+        glGenTextures(1, &accumTexture);
+        glGenTextures(1, &weightTexture);
+        glGenTextures(1, &depthTexture);
+    }
+    allocateTarget(accumTexture, GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT, width, height);
+    allocateTarget(weightTexture, GL_R16F, GL_RED, GL_HALF_FLOAT, width, height);
+    // Depth blits need an identical format; GLFW's default framebuffer is D24S8
+    allocateTarget(depthTexture, GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, width, height);
+    glState.bindTexture(GL_TEXTURE_2D, 0);
+    glState.bindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, accumTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, weightTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+    const GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, drawBuffers);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glState.bindFramebuffer(GL_FRAMEBUFFER, previousFBO);
+    if (!complete) {
+        logger.addLog(LogLevel::Error, "OIT framebuffer incomplete, falling back to plain blending.");
+        failed = true;
+    }
+    return complete;
+}
+
+// Everything that can fail happens here, once per size: the targets and a trial depth copy from
+// the framebuffer bound now
+bool OitRenderer::prepare(int width, int height) {
+    if (failed || width <= 0 || height <= 0) return false;
+    if (width == targetWidth && height == targetHeight) return true;
+    previousFBO = glState.getFramebuffer(GL_FRAMEBUFFER);
+    if (!ensureTargets(width, height)) return false;
+    while (glGetError() != GL_NO_ERROR) {}
+    glState.bindFramebuffer(GL_READ_FRAMEBUFFER, previousFBO);
+    glState.bindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    bool copied = glGetError() == GL_NO_ERROR;
+    glState.bindFramebuffer(GL_FRAMEBUFFER, previousFBO);
+    if (!copied) {
+        logger.addLog(LogLevel::Error, "Depth buffer cannot be copied (format mismatch), falling back to plain blending.");
+        failed = true;
+    }
+    return copied;
+}
+
+void OitRenderer::begin() {
+    previousFBO = glState.getFramebuffer(GL_FRAMEBUFFER);
+    // Opaque depth so translucent geometry behind the floor stays hidden
+    glState.bindFramebuffer(GL_READ_FRAMEBUFFER, previousFBO);
+    glState.bindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+    glBlitFramebuffer(0, 0, targetWidth, targetHeight, 0, 0, targetWidth, targetHeight, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    glState.bindFramebuffer(GL_FRAMEBUFFER, fbo);
+    const float clearAccum[] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    const float clearWeight[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    glClearBufferfv(GL_COLOR, 0, clearAccum);
+    glClearBufferfv(GL_COLOR, 1, clearWeight);
+    glState.depthMask(false);
+    glState.setEnabled(GL_BLEND, true);
+    // rgb (and target 1) add up, alpha multiplies into the revealage
+    glState.blendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+void OitRenderer::composite() {
+    glState.bindFramebuffer(GL_FRAMEBUFFER, previousFBO);
+    glState.depthMask(true);
+    glState.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    bool depthTest = glState.isEnabled(GL_DEPTH_TEST);
+    glState.setEnabled(GL_DEPTH_TEST, false);
+    glState.useProgram(compositeShader->ID);
+    glUniform1i(glGetUniformLocation(compositeShader->ID, "accumTexture"), 0);
+    glUniform1i(glGetUniformLocation(compositeShader->ID, "weightTexture"), 1);
+    glState.activeTexture(GL_TEXTURE0);
+    glState.bindTexture(GL_TEXTURE_2D, accumTexture);
+    glState.activeTexture(GL_TEXTURE1);
+    glState.bindTexture(GL_TEXTURE_2D, weightTexture);
+    glState.bindVertexArray(emptyVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glState.activeTexture(GL_TEXTURE0);
+    if (depthTest) glState.setEnabled(GL_DEPTH_TEST, true);
+}
@@ -0,0 +1,32 @@
+// OitRenderer.h
+#pragma once
+#include "Shader.h"
+
+// Weighted blended order-independent transparency (McGuire & Bavoil 2013). Between begin() and
+// composite() translucent draws land in two float targets instead of the framebuffer:
+//   target 0 (RGBA16F): rgb = sum of color * alpha * weight, a = product of (1 - alpha)
+//   target 1 (R16F):    sum of alpha * weight
+// Both come out of one glBlendFuncSeparate (per-target blend functions need GL 4.0), so draw
+// order does not matter and nothing has to be sorted. composite() resolves the weighted average
+// over whatever was bound at begin(). Depth is tested against a copy of the opaque depth and
+// never written.
+class OitRenderer {
+public:
+    OitRenderer();
+    ~OitRenderer();
+    // False if OIT cannot be used at this size (the caller blends plainly instead); call before
+    // deciding which shaders to draw with
+    bool prepare(int width, int height);
+    // Redirects drawing into the accumulation targets; only after prepare() succeeded for the
+    // current size, and then it cannot fail
+    void begin();
+    void composite();
+private:
+    Shader* compositeShader;
+    unsigned int emptyVAO;
+    unsigned int fbo, accumTexture, weightTexture, depthTexture;
+    int targetWidth, targetHeight;
+    unsigned int previousFBO;
+    bool failed;
+    bool ensureTargets(int width, int height);
+};
@@ -1,19 +1,42 @@
 // ParticleSystem.cpp
 #include "ParticleSystem.h"
+#include "GlState.h"
 #include "Globals.h"
 #include "Logger.h"
 #include <glad/glad.h>
 #include <glm/gtc/matrix_transform.hpp>
-#include <cstdlib>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
 
-ParticleSystem::ParticleSystem() : initialized(false) {
+ParticleSystem::ParticleSystem(size_t capacity)
+    : particles(capacity), liveCount(0), rng(std::random_device{}()), instanceCapacity(0), initialized(false),
+    recordTarget(nullptr), recordView(1.0f), recordProjection(1.0f), recordGeneration(0), recordPending(false),
+    recordStopping(false)
+{
+    instanceData.reserve(capacity);
+    emitters.reserve(kMaxEmitters);
     particleShader = new Shader();
     unsigned int program = loadShader("shaders/particle.vert", "shaders/particle.frag");
     if (program == 0) {
-        logger.addLog("[ERROR] Failed to load particle shader.");
+        logger.addLog(LogLevel::Error, "Failed to load particle shader.");
     }
     particleShader->ID = program;
     initRenderData();
+    recordWorker = std::thread(&ParticleSystem::recordLoop, this);
+}
+
+ParticleSystem::~ParticleSystem() {
+    {
+        std::lock_guard<std::mutex> lock(recordMutex);
+        recordStopping = true;
+    }
+    recordWake.notify_one();
+    recordWorker.join();
+    delete particleShader;
+    glState.deleteVertexArrays(1, &VAO);
+    glState.deleteBuffers(1, &VBO);
+    glState.deleteBuffers(1, &instanceVBO);
 }
 
 void ParticleSystem::initRenderData() {
@@ -28,64 +51,213 @@ void ParticleSystem::initRenderData() {
     };
     glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO);
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glState.bindVertexArray(VAO);
+    glState.bindBuffer(GL_ARRAY_BUFFER, VBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), quadVertices, GL_STATIC_DRAW);
     glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
-    glBindVertexArray(0);
+    // Per-instance position + life, streamed each frame
+    glGenBuffers(1, &instanceVBO);
+    glState.bindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribDivisor(1, 1);
+    glState.bindVertexArray(0);
     initialized = true;
 }
 
-void ParticleSystem::initialize(const glm::vec3& origin, float impactAngle) {
-    particles.clear();
-    int count = 100;
-    for (int i = 0; i < count; ++i) {
-        Particle p;
-        p.position = origin;
+Particle* ParticleSystem::spawn() {
+    if (liveCount == particles.size()) return nullptr;
+    return &particles[liveCount++];
+}
+
+void ParticleSystem::kill(size_t index) {
+    // Swap-remove keeps the live range contiguous
+    particles[index] = particles[--liveCount];
+}
+
+void ParticleSystem::emit(const EmitterDesc& desc, unsigned int count) {
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::uniform_real_distribution<float> lifeDist(desc.minLife, std::max(desc.minLife, desc.maxLife));
+    for (unsigned int i = 0; i < count; ++i) {
+        Particle* p = spawn();
+        if (!p) return;
+        p->position = desc.origin;
         // Random speed between 0 and 5
-        float speed = ((rand() % 100) / 100.0f) * 5.0f;
+        float speed = unit(rng) * 5.0f;
         // Vary the angle slightly based on impactAngle
-        float angle = impactAngle + ((rand() % 50) - 25) * 0.1f;
-        float rad = glm::radians(angle);
-        p.velocity = glm::vec3(speed * cos(rad), speed * sin(rad), ((rand() % 100) / 100.0f) * 5.0f);
-        p.life = 3.0f;
-        particles.push_back(p);
+        float rad = glm::radians(desc.impactAngle + (unit(rng) * 5.0f - 2.5f));
+        p->velocity = glm::vec3(speed * cos(rad), speed * sin(rad), unit(rng) * 5.0f);
+        p->life = lifeDist(rng);
     }
 }
 
-void ParticleSystem::update(float dt) {
-    for (auto& p : particles) {
-        if (p.life > 0.0f) {
-            p.life -= dt;
-            p.velocity.y -= 9.81f * dt;
-            p.position += p.velocity * dt;
+void ParticleSystem::initialize(const glm::vec3& origin, float impactAngle) {
+    reset();
+    EmitterDesc desc;
+    desc.origin = origin;
+    desc.impactAngle = impactAngle;
+    desc.burst = 100;
+    addEmitter(desc);
+}
+
+void ParticleSystem::addEmitter(const EmitterDesc& desc) {
+    emit(desc, desc.burst);
+    if (desc.rate > 0.0f && desc.duration > 0.0f) {
+        if (emitters.size() == kMaxEmitters) {
+            logger.addLog(LogLevel::Warning, "Too many particle emitters, continuous emission dropped.");
+            return;
         }
+        Emitter emitter;
+        emitter.desc = desc;
+        emitter.elapsed = 0.0f;
+        emitter.accumulator = 0.0f;
+        emitters.push_back(emitter);
     }
 }
 
-void ParticleSystem::render(const glm::mat4& view, const glm::mat4& projection) {
-    glUseProgram(particleShader->ID);
-    glUniformMatrix4fv(glGetUniformLocation(particleShader->ID, "view"), 1, GL_FALSE, &view[0][0]);
-    glUniformMatrix4fv(glGetUniformLocation(particleShader->ID, "projection"), 1, GL_FALSE, &projection[0][0]);
-    glBindVertexArray(VAO);
-    for (auto& p : particles) {
-        if (p.life > 0.0f) {
-            glm::mat4 model = glm::translate(glm::mat4(1.0f), p.position);
-            glUniformMatrix4fv(glGetUniformLocation(particleShader->ID, "model"), 1, GL_FALSE, &model[0][0]);
-            glDrawArrays(GL_TRIANGLES, 0, 6);
+size_t ParticleSystem::emitBatch(const Particle* batch, size_t count) {
+    count = std::min(count, particles.size() - liveCount);
+    std::copy(batch, batch + count, particles.begin() + liveCount);
+    liveCount += count;
+    return count;
+}
+
+void ParticleSystem::update(float dt) {
+    for (size_t i = 0; i < emitters.size();) {
+        Emitter& e = emitters[i];
+        float active = std::min(dt, e.desc.duration - e.elapsed);
+        e.elapsed += dt;
+        e.accumulator += e.desc.rate * active;
+        unsigned int count = static_cast<unsigned int>(e.accumulator);
+        e.accumulator -= count;
+        emit(e.desc, count);
+        if (e.elapsed >= e.desc.duration) {
+            emitters[i] = emitters.back();
+            emitters.pop_back();
+        }
+        else {
+            ++i;
         }
     }
-    glBindVertexArray(0);
+    for (size_t i = 0; i < liveCount;) {
+        Particle& p = particles[i];
+        p.life -= dt;
+        if (p.life <= 0.0f) {
+            // The swapped-in particle is processed at the same index
+            kill(i);
+            continue;
+        }
+        p.velocity.y -= 9.81f * dt;
+        p.position += p.velocity * dt;
+        ++i;
+    }
+}
+
+void ParticleSystem::recordCommands(CommandBuffer& commands, const glm::mat4& view, const glm::mat4& projection) {
+    if (liveCount == 0) return;
+    TRACE_SCOPE("ParticleSystem::recordCommands");
+    instanceData.resize(liveCount);
+    for (size_t i = 0; i < liveCount; ++i)
+        instanceData[i] = glm::vec4(particles[i].position, particles[i].life);
+    if (instanceData.size() > instanceCapacity)
+        instanceCapacity = std::max(instanceData.size(), instanceCapacity * 2);
+    // Orphan last frame's storage so the upload never waits on a draw still in flight
+    commands.upload(RenderPass::Particles, GL_ARRAY_BUFFER, instanceVBO, instanceData.data(),
+        instanceData.size() * sizeof(glm::vec4), instanceCapacity * sizeof(glm::vec4), GL_STREAM_DRAW);
+    CommandBuffer::DrawDesc draw;
+    draw.program = particleShader->ID;
+    draw.vertexArray = VAO;
+    draw.count = 6;
+    draw.instanceCount = static_cast<GLsizei>(instanceData.size());
+    commands.draw(RenderPass::Particles, draw);
+    commands.uniform("view", view);
+    commands.uniform("projection", projection);
+}
+
+void ParticleSystem::startRecording(CommandBuffer& commands, const glm::mat4& view, const glm::mat4& projection) {
+    {
+        std::lock_guard<std::mutex> lock(recordMutex);
+        recordTarget = &commands;
+        recordView = view;
+        recordProjection = projection;
+        recordPending = true;
+        recordGeneration++;
+    }
+    recordWake.notify_one();
+}
+
+void ParticleSystem::finishRecording() {
+    std::unique_lock<std::mutex> lock(recordMutex);
+    recordDone.wait(lock, [this]() { return !recordPending; });
+}
+
+void ParticleSystem::recordLoop() {
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(recordMutex);
+    for (;;) {
+        recordWake.wait(lock, [&]() { return recordStopping || recordGeneration != seen; });
+        if (recordStopping) return;
+        seen = recordGeneration;
+        lock.unlock();
+        recordCommands(*recordTarget, recordView, recordProjection);
+        lock.lock();
+        recordPending = false;
+        recordDone.notify_one();
+    }
 }
 
 bool ParticleSystem::isFinished() const {
-    for (const auto& p : particles)
-        if (p.life > 0.0f)
-            return false;
-    return true;
+    return liveCount == 0 && emitters.empty();
 }
 
 void ParticleSystem::reset() {
-    particles.clear();
+    liveCount = 0;
+    emitters.clear();
+}
+
+void ParticleSystem::benchmarkSubmit(const glm::mat4& view, const glm::mat4& projection) {
+    // The large counts grow the pool and the instance buffers; all of it is put back afterwards
+    std::vector<Particle> saved;
+    saved.swap(particles);
+    size_t savedLive = liveCount;
+    std::vector<glm::vec4> savedInstances;
+    savedInstances.swap(instanceData);
+    size_t savedInstanceCapacity = instanceCapacity;
+    const size_t counts[] = { 1000, 10000, 100000, 1000000 };
+    const int iterations = 10;
+    for (size_t count : counts) {
+        particles.resize(count);
+        liveCount = count;
+        for (size_t i = 0; i < count; ++i) {
+            particles[i].position = glm::vec3((i % 100) * 0.1f - 5.0f, (i / 10000) * 0.1f, ((i / 100) % 100) * 0.1f - 5.0f);
+            particles[i].velocity = glm::vec3(0.0f);
+            particles[i].life = 1.0f;
+        }
+        CommandBuffer commands;
+        recordCommands(commands, view, projection);   // warm up buffer growth
+        commands.submit(RenderPass::Particles);
+        glFinish();
+        double totalMs = 0.0;
+        for (int i = 0; i < iterations; ++i) {
+            auto start = std::chrono::high_resolution_clock::now();
+            commands.clear();
+            recordCommands(commands, view, projection);
+            commands.submit(RenderPass::Particles);
+            auto end = std::chrono::high_resolution_clock::now();
+            totalMs += std::chrono::duration<double, std::milli>(end - start).count();
+            // Keep GPU time out of the next measurement
+            glFinish();
+        }
+        char line[128];
+        snprintf(line, sizeof(line), "Particle submit: %zu particles, %.3f ms CPU per frame", count, totalMs / iterations);
+        logger.addLog(line);
+    }
+    particles.swap(saved);
+    liveCount = savedLive;
+    instanceData.swap(savedInstances);
+    instanceCapacity = savedInstanceCapacity;
+    // Shrink the GPU side now rather than at the next upload, which an empty pool never makes
+    glState.bindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(instanceCapacity * sizeof(glm::vec4)), nullptr, GL_STREAM_DRAW);
 }
@@ -1,7 +1,13 @@
 // ParticleSystem.h
 #pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <thread>
 #include <vector>
 #include <glm/glm.hpp>
+#include "CommandBuffer.h"
 #include "Shader.h"
 
 struct Particle {
@@ -10,18 +16,68 @@ struct Particle {
     float life;
 };
 
+// Continuous or burst emission into the particle pool
+struct EmitterDesc {
+    glm::vec3 origin = glm::vec3(0.0f);
+    float impactAngle = 45.0f;
+    float rate = 0.0f;          // particles per second while active
+    unsigned int burst = 0;     // particles spawned immediately
+    float duration = 0.0f;      // seconds of continuous emission
+    float minLife = 3.0f;       // lifetime is uniform in [minLife, maxLife]
+    float maxLife = 3.0f;
+};
+
 class ParticleSystem {
 public:
-    ParticleSystem();
+    explicit ParticleSystem(size_t capacity = 4096);
+    ~ParticleSystem();
     void initialize(const glm::vec3& origin, float impactAngle);
+    // At most kMaxEmitters run at once; past that the burst is still emitted, the rate is dropped
+    void addEmitter(const EmitterDesc& desc);
+    // Copies pre-built particles straight into the free tail of the pool; returns how many fit
+    size_t emitBatch(const Particle* batch, size_t count);
     void update(float dt);
-    void render(const glm::mat4& view, const glm::mat4& projection);
+    // Any thread, not concurrently with update() or emission; the upload points into instanceData
+    // until the next recordCommands()
+    void recordCommands(CommandBuffer& commands, const glm::mat4& view, const glm::mat4& projection);
+    // recordCommands() on the pool's own worker thread, kept for the pool's lifetime so a frame
+    // never starts a thread; finishRecording() waits for it. The same rules apply until then
+    void startRecording(CommandBuffer& commands, const glm::mat4& view, const glm::mat4& projection);
+    void finishRecording();
     bool isFinished() const;
     void reset();
+    size_t getLiveCount() const { return liveCount; }
+    size_t getCapacity() const { return particles.size(); }
+    // Times recordCommands() plus submission on the CPU for increasing particle counts and logs the results
+    void benchmarkSubmit(const glm::mat4& view, const glm::mat4& projection);
+    static const size_t kMaxEmitters = 8;
 private:
+    struct Emitter {
+        EmitterDesc desc;
+        float elapsed;
+        float accumulator;      // fractional particles carried between frames
+    };
+    // Fixed-capacity pool: [0, liveCount) are alive, the rest is free storage
     std::vector<Particle> particles;
+    size_t liveCount;
+    std::vector<Emitter> emitters;
+    std::mt19937 rng;
+    std::vector<glm::vec4> instanceData;    // packed position + life, reused every frame
     Shader* particleShader;
-    unsigned int VAO, VBO;
+    unsigned int VAO, VBO, instanceVBO;
+    size_t instanceCapacity;
     bool initialized;
+    std::thread recordWorker;
+    std::mutex recordMutex;
+    std::condition_variable recordWake, recordDone;
+    CommandBuffer* recordTarget;
+    glm::mat4 recordView, recordProjection;
+    uint64_t recordGeneration;
+    bool recordPending;
+    bool recordStopping;
+    void recordLoop();
     void initRenderData();
+    Particle* spawn();
+    void kill(size_t index);
+    void emit(const EmitterDesc& desc, unsigned int count);
 };
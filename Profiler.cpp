@@ -0,0 +1,229 @@
+// Profiler.cpp
+#include "Profiler.h"
+#include "Globals.h"
+#include "Logger.h"
+#include "imgui.h"
+#include <glad/glad.h>
+#include <fstream>
+#include <cfloat>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+
+double Profiler::elapsedMs() const {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+}
+
+void Profiler::beginFrame() {
+    frameStart = std::chrono::steady_clock::now();
+    current.index = frameIndex;
+    current.frameMs = 0.0;
+    current.cpu.clear();
+    current.gpu.clear();
+    current.counters.clear();
+    openScopes.clear();
+    // This slot was last used two frames ago, so its queries are normally resolved already
+    GpuSlot& slot = gpuSlots[frameIndex % 2];
+    if (slot.pending) collectGpu(slot);
+    slot.count = 0;
+    slot.frame = frameIndex;
+}
+
+void Profiler::endFrame() {
+    while (!openScopes.empty()) endScope();
+    if (gpuActive) endGpu();
+    current.frameMs = elapsedMs();
+    GpuSlot& slot = gpuSlots[frameIndex % 2];
+    slot.pending = slot.count > 0;
+    if (!paused) {
+        // Swap instead of copy so sample vectors keep their capacity
+        std::swap(history[historyHead], current);
+        historyHead = (historyHead + 1) % kHistory;
+        if (historySize < kHistory) historySize++;
+    }
+    frameIndex++;
+}
+
+void Profiler::beginScope(const char* name) {
+    Sample sample;
+    sample.name = name;
+    sample.depth = static_cast<int>(openScopes.size());
+    sample.startMs = elapsedMs();
+    sample.durationMs = 0.0;
+    openScopes.push_back(static_cast<int>(current.cpu.size()));
+    current.cpu.push_back(sample);
+}
+
+void Profiler::endScope() {
+    if (openScopes.empty()) return;
+    Sample& sample = current.cpu[openScopes.back()];
+    openScopes.pop_back();
+    sample.durationMs = elapsedMs() - sample.startMs;
+}
+
+void Profiler::beginGpu(const char* name) {
+    if (!gpuInitialized) {
+        for (auto& slot : gpuSlots)
+            glGenQueries(kMaxGpuPasses, slot.queries);
+        gpuInitialized = true;
+    }
+    GpuSlot& slot = gpuSlots[frameIndex % 2];
+    if (gpuActive || slot.count == kMaxGpuPasses) return;
+    slot.names[slot.count] = name;
+    glBeginQuery(GL_TIME_ELAPSED, slot.queries[slot.count]);
+    gpuActive = true;
+}
+
+void Profiler::endGpu() {
+    if (!gpuActive) return;
+    glEndQuery(GL_TIME_ELAPSED);
+    gpuSlots[frameIndex % 2].count++;
+    gpuActive = false;
+}
+
+void Profiler::collectGpu(GpuSlot& slot) {
+    slot.pending = false;
+    GLint available = 0;
+    glGetQueryObjectiv(slot.queries[slot.count - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+    // Drop the sample rather than stall the pipeline
+    if (!available) return;
+    Frame* frame = findFrame(slot.frame);
+    if (!frame) return;
+    for (int i = 0; i < slot.count; ++i) {
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(slot.queries[i], GL_QUERY_RESULT, &ns);
+        Sample sample;
+        sample.name = slot.names[i];
+        sample.depth = 0;
+        sample.startMs = i;
+        sample.durationMs = ns / 1.0e6;
+        frame->gpu.push_back(sample);
+    }
+}
+
+Profiler::Frame* Profiler::findFrame(unsigned long long index) {
+    for (int i = 1; i <= historySize && i <= 4; ++i) {
+        Frame& frame = history[(historyHead - i + kHistory) % kHistory];
+        if (frame.index == index) return &frame;
+    }
+    return nullptr;
+}
+
+void Profiler::shutdown() {
+    if (!gpuInitialized) return;
+    for (auto& slot : gpuSlots)
+        glDeleteQueries(kMaxGpuPasses, slot.queries);
+    gpuInitialized = false;
+}
+
+static ImU32 colorForName(const char* name) {
+    size_t h = std::hash<std::string>()(name);
+    return ImColor::HSV((h % 360) / 360.0f, 0.55f, 0.85f);
+}
+
+void Profiler::draw(const std::string& title) {
+    ImGui::Begin(title.c_str());
+    ImGui::Checkbox("Pause", &paused);
+    ImGui::SameLine();
+    if (ImGui::Button("Export CSV")) {
+        if (exportCsv("profile.csv")) logger.addLog("Profiler history written to profile.csv");
+        else logger.addLog(LogLevel::Error, "Failed to write profile.csv");
+    }
+    if (historySize == 0) {
+        ImGui::End();
+        return;
+    }
+    float frameTimes[kHistory];
+    for (int i = 0; i < historySize; ++i)
+        frameTimes[i] = static_cast<float>(history[(historyHead - historySize + i + kHistory) % kHistory].frameMs);
+    const Frame& latest = history[(historyHead - 1 + kHistory) % kHistory];
+    char overlay[32];
+    snprintf(overlay, sizeof(overlay), "%.2f ms", latest.frameMs);
+    ImGui::PlotLines("Frame", frameTimes, historySize, 0, overlay, 0.0f, FLT_MAX, ImVec2(0.0f, 60.0f));
+
+    // Older frames can be inspected while paused
+    static int frameOffset = 0;
+    if (!paused) frameOffset = 0;
+    ImGui::SliderInt("Frames back", &frameOffset, 0, historySize - 1);
+    const Frame& frame = history[(historyHead - 1 - frameOffset + 2 * kHistory) % kHistory];
+
+    // Flame graph: x is time within the frame, rows are scope depth
+    const float rowHeight = ImGui::GetTextLineHeight() + 4.0f;
+    int maxDepth = 0;
+    for (const auto& s : frame.cpu) maxDepth = std::max(maxDepth, s.depth);
+    ImVec2 origin = ImGui::GetCursorScreenPos();
+    float width = ImGui::GetContentRegionAvail().x;
+    float scale = frame.frameMs > 0.0 ? width / static_cast<float>(frame.frameMs) : 0.0f;
+    ImDrawList* drawList = ImGui::GetWindowDrawList();
+    ImVec2 mouse = ImGui::GetMousePos();
+    for (const auto& s : frame.cpu) {
+        ImVec2 a(origin.x + static_cast<float>(s.startMs) * scale, origin.y + s.depth * rowHeight);
+        ImVec2 b(a.x + std::max(static_cast<float>(s.durationMs) * scale, 1.0f), a.y + rowHeight - 1.0f);
+        drawList->AddRectFilled(a, b, colorForName(s.name));
+        drawList->PushClipRect(a, b, true);
+        drawList->AddText(ImVec2(a.x + 2.0f, a.y + 2.0f), IM_COL32_BLACK, s.name);
+        drawList->PopClipRect();
+        if (mouse.x >= a.x && mouse.x < b.x && mouse.y >= a.y && mouse.y < b.y)
+            ImGui::SetTooltip("%s: %.3f ms", s.name, s.durationMs);
+    }
+    ImGui::Dummy(ImVec2(width, (maxDepth + 1) * rowHeight));
+
+    ImGui::Text("CPU frame: %.3f ms", frame.frameMs);
+    double gpuTotal = 0.0;
+    for (const auto& s : frame.gpu) {
+        ImGui::Text("GPU %-12s %.3f ms", s.name, s.durationMs);
+        gpuTotal += s.durationMs;
+    }
+    if (frame.gpu.empty()) ImGui::TextUnformatted("GPU timings pending");
+    else ImGui::Text("GPU total: %.3f ms", gpuTotal);
+    for (const auto& c : frame.counters)
+        ImGui::Text("%-20s %.0f", c.name, c.value);
+    ImGui::End();
+}
+
+bool Profiler::exportCsv(const std::string& path) const {
+    std::ofstream file(path);
+    if (!file.is_open()) return false;
+    file << "frame,kind,name,depth,start_ms,duration_ms\n";
+    for (int i = 0; i < historySize; ++i) {
+        const Frame& frame = history[(historyHead - historySize + i + kHistory) % kHistory];
+        file << frame.index << ",frame,total,0,0," << frame.frameMs << "\n";
+        for (const auto& s : frame.cpu)
+            file << frame.index << ",cpu," << s.name << "," << s.depth << "," << s.startMs << "," << s.durationMs << "\n";
+        for (const auto& s : frame.gpu)
+            file << frame.index << ",gpu," << s.name << ",0," << s.startMs << "," << s.durationMs << "\n";
+        for (const auto& c : frame.counters)
+            file << frame.index << ",counter," << c.name << ",0,0," << c.value << "\n";
+    }
+    return true;
+}
+
+void Profiler::setCounter(const char* name, double value) {
+    for (auto& counter : current.counters) {
+        if (strcmp(counter.name, name) == 0) {
+            counter.value = value;
+            return;
+        }
+    }
+    Counter counter;
+    counter.name = name;
+    counter.value = value;
+    current.counters.push_back(counter);
+}
+
+ProfileScope::ProfileScope(const char* name) : trace(name) {
+    profiler.beginScope(name);
+}
+
+ProfileScope::~ProfileScope() {
+    profiler.endScope();
+}
+
+GpuProfileScope::GpuProfileScope(const char* name) {
+    profiler.beginGpu(name);
+}
+
+GpuProfileScope::~GpuProfileScope() {
+    profiler.endGpu();
+}
@@ -0,0 +1,86 @@
+// Profiler.h
+#pragma once
+#include <string>
+#include <vector>
+#include <chrono>
+#include "Trace.h"
+
+// Per-frame hierarchical CPU scopes plus GL_TIME_ELAPSED GPU passes, kept for a rolling window of frames
+class Profiler {
+public:
+    struct Sample {
+        const char* name;
+        int depth;
+        double startMs;     // relative to frame start
+        double durationMs;
+    };
+    struct Counter {
+        const char* name;
+        double value;
+    };
+    struct Frame {
+        unsigned long long index = 0;
+        double frameMs = 0.0;
+        std::vector<Sample> cpu;
+        std::vector<Sample> gpu;    // depth unused, startMs is submission order
+        std::vector<Counter> counters;
+    };
+    void beginFrame();
+    void endFrame();
+    void beginScope(const char* name);
+    void endScope();
+    // GPU passes cannot nest: GL allows one GL_TIME_ELAPSED query active at a time
+    void beginGpu(const char* name);
+    void endGpu();
+    // Per-frame value shown under the timings; setting the same name twice in a frame overwrites it
+    void setCounter(const char* name, double value);
+    void draw(const std::string& title);
+    bool exportCsv(const std::string& path) const;
+    void shutdown();
+private:
+    static const int kHistory = 240;
+    static const int kMaxGpuPasses = 16;
+    // Queries are double-buffered: beginFrame() of frame N reads back frame N-2's results, from the
+    // slot it is about to reuse, so it never stalls
+    struct GpuSlot {
+        unsigned int queries[kMaxGpuPasses] = {};
+        const char* names[kMaxGpuPasses] = {};
+        int count = 0;
+        unsigned long long frame = 0;
+        bool pending = false;
+    };
+    std::chrono::steady_clock::time_point frameStart;
+    Frame current;
+    std::vector<int> openScopes;
+    std::vector<Frame> history = std::vector<Frame>(kHistory);
+    int historyHead = 0;
+    int historySize = 0;
+    GpuSlot gpuSlots[2];
+    bool gpuInitialized = false;
+    bool gpuActive = false;
+    bool paused = false;
+    unsigned long long frameIndex = 0;
+    double elapsedMs() const;
+    void collectGpu(GpuSlot& slot);
+    Frame* findFrame(unsigned long long index);
+};
+
+// Profiler scopes are main-thread only; they also land in the trace via TraceScope
+class ProfileScope {
+public:
+    explicit ProfileScope(const char* name);
+    ~ProfileScope();
+private:
+    TraceScope trace;
+};
+
+class GpuProfileScope {
+public:
+    explicit GpuProfileScope(const char* name);
+    ~GpuProfileScope();
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_GPU(name) GpuProfileScope PROFILE_CONCAT(gpuProfileScope, __LINE__)(name)
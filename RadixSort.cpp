@@ -0,0 +1,117 @@
+// RadixSort.cpp
+#include "RadixSort.h"
+#include "Globals.h"
+#include <algorithm>
+#include <cstring>
+
+RadixSorter::RadixSorter(unsigned threads)
+    : threadCount(threads), job(nullptr), generation(0), pending(0), stopping(false)
+{
+    if (threadCount == 0) threadCount = std::min(kMaxThreads, std::max(1u, std::thread::hardware_concurrency()));
+    // The calling thread sorts slice 0
+    for (unsigned slice = 1; slice < threadCount; ++slice)
+        workers.emplace_back(&RadixSorter::workerLoop, this, slice);
+}
+
+RadixSorter::~RadixSorter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) worker.join();
+}
+
+uint32_t RadixSorter::floatKey(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    // Positive: set the sign bit so they sort above negatives; negative: flip all bits so larger
+    // magnitudes sort lower
+    return (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+}
+
+void RadixSorter::workerLoop(unsigned slice) {
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        wake.wait(lock, [&]() { return stopping || generation != seen; });
+        if (stopping) return;
+        seen = generation;
+        const std::function<void(unsigned)>* fn = job;
+        lock.unlock();
+        (*fn)(slice);
+        lock.lock();
+        if (--pending == 0) done.notify_one();
+    }
+}
+
+void RadixSorter::runSlices(unsigned slices, const std::function<void(unsigned)>& fn) {
+    if (slices == 1) {
+        fn(0);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = &fn;
+        pending = static_cast<unsigned>(workers.size());
+        generation++;
+    }
+    wake.notify_all();
+    fn(0);
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&]() { return pending == 0; });
+}
+
+void RadixSorter::sort(std::vector<uint32_t>& keys, std::vector<uint32_t>& values) {
+    TRACE_SCOPE("RadixSorter::sort");
+    size_t count = keys.size();
+    keyScratch.resize(count);
+    valueScratch.resize(count);
+    unsigned slices = count < kParallelThreshold ? 1 : threadCount;
+    histograms.resize(slices * 256);
+    uint32_t* srcKeys = keys.data();
+    uint32_t* srcValues = values.data();
+    uint32_t* dstKeys = keyScratch.data();
+    uint32_t* dstValues = valueScratch.data();
+    int shift = 0;
+    auto first = [&](unsigned slice) { return count * slice / slices; };
+    std::function<void(unsigned)> histogram = [&](unsigned slice) {
+        uint32_t* counts = &histograms[slice * 256];
+        std::fill(counts, counts + 256, 0u);
+        for (size_t i = first(slice), end = first(slice + 1); i < end; ++i)
+            counts[(srcKeys[i] >> shift) & 0xFF]++;
+    };
+    std::function<void(unsigned)> scatter = [&](unsigned slice) {
+        uint32_t* offsets = &histograms[slice * 256];
+        for (size_t i = first(slice), end = first(slice + 1); i < end; ++i) {
+            uint32_t position = offsets[(srcKeys[i] >> shift) & 0xFF]++;
+            dstKeys[position] = srcKeys[i];
+            dstValues[position] = srcValues[i];
+        }
+    };
+    for (shift = 0; shift < 32; shift += 8) {
+        runSlices(slices, histogram);
+        // Exclusive prefix sum, bucket-major then slice
+        uint32_t sum = 0;
+        bool singleDigit = false;
+        for (unsigned bucket = 0; bucket < 256; ++bucket) {
+            uint32_t bucketTotal = 0;
+            for (unsigned slice = 0; slice < slices; ++slice) {
+                uint32_t n = histograms[slice * 256 + bucket];
+                histograms[slice * 256 + bucket] = sum;
+                sum += n;
+                bucketTotal += n;
+            }
+            if (bucketTotal == count) singleDigit = true;
+        }
+        // Every key has the same digit here: the pass would only copy
+        if (singleDigit) continue;
+        runSlices(slices, scatter);
+        std::swap(srcKeys, dstKeys);
+        std::swap(srcValues, dstValues);
+    }
+    if (srcKeys != keys.data()) {
+        keys.swap(keyScratch);
+        values.swap(valueScratch);
+    }
+}
@@ -0,0 +1,41 @@
+// RadixSort.h
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Stable LSD radix sort of 32-bit keys carrying a 32-bit value, four 8-bit passes. Each pass
+// histograms per-thread slices, prefix-sums bucket-major (so equal digits keep slice order, which
+// keeps the sort stable) and scatters every slice in parallel. Passes where all keys share one
+// digit are skipped. The workers are kept between calls since a frame-rate sort cannot afford
+// to start threads every time; small inputs are sorted on the calling thread.
+class RadixSorter {
+public:
+    explicit RadixSorter(unsigned threadCount = 0);  // 0: hardware concurrency, at most kMaxThreads
+    ~RadixSorter();
+    RadixSorter(const RadixSorter&) = delete;
+    RadixSorter& operator=(const RadixSorter&) = delete;
+    // Ascending by key; values are permuted along with the keys
+    void sort(std::vector<uint32_t>& keys, std::vector<uint32_t>& values);
+    unsigned getThreadCount() const { return threadCount; }
+    static constexpr unsigned kMaxThreads = 8;
+    static constexpr size_t kParallelThreshold = 1 << 15;
+    // Order-preserving float -> uint32 mapping (negative values included)
+    static uint32_t floatKey(float value);
+private:
+    unsigned threadCount;
+    std::vector<uint32_t> keyScratch, valueScratch;
+    std::vector<uint32_t> histograms;   // 256 counters per slice
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    const std::function<void(unsigned)>* job;
+    uint64_t generation;
+    unsigned pending;
+    bool stopping;
+    void workerLoop(unsigned slice);
+    void runSlices(unsigned slices, const std::function<void(unsigned)>& fn);
+};
@@ -2,15 +2,20 @@
 #include "Shader.h"
 #include "Globals.h"
 #include "Logger.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <sstream>
-#include <iostream>
+#include <vector>
+
+ShaderManager shaderManager;
 
 std::string readFile(const char* path) {
     std::ifstream file(path);
     if (!file.is_open()) {
-        std::cerr << "ERROR::FILE::READ_FAILED: " << path << "\n";
-        logger.addLog(" Failed to load: " + std::string(path));
+        logger.addLog(LogLevel::Error, "Failed to load: " + std::string(path));
         return "";
     }
     std::stringstream stream;
@@ -20,6 +25,60 @@ std::string readFile(const char* path) {
     return stream.str();
 }
 
+static bool expandIncludes(const std::string& path, const std::vector<std::string>& defines, std::string& output,
+    std::vector<std::string>& files, std::unordered_map<std::string, std::string>* sources) {
+    std::string fileIndex = std::to_string(files.size());
+    files.push_back(path);
+    std::string source;
+    auto cached = sources ? sources->find(path) : std::unordered_map<std::string, std::string>::iterator();
+    if (sources && cached != sources->end()) {
+        source = cached->second;
+    }
+    else {
+        source = readFile(path.c_str());
+        if (sources && !source.empty()) (*sources)[path] = source;
+    }
+    if (source.empty()) return false;
+    std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+    std::istringstream lines(source);
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(lines, line)) {
+        lineNumber++;
+        size_t start = line.find_first_not_of(" \t");
+        if (start != std::string::npos && line.compare(start, 8, "#include") == 0) {
+            size_t open = line.find('"', start);
+            size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+            if (close == std::string::npos) {
+                logger.addLog(LogLevel::Error, "Malformed #include at " + path + ":" + std::to_string(lineNumber));
+                return false;
+            }
+            std::string included = directory + line.substr(open + 1, close - open - 1);
+            if (std::find(files.begin(), files.end(), included) == files.end()) {
+                output += "#line 1 " + std::to_string(files.size()) + "\n";
+                if (!expandIncludes(included, {}, output, files, sources)) return false;
+            }
+            output += "#line " + std::to_string(lineNumber + 1) + " " + fileIndex + "\n";
+            continue;
+        }
+        output += line;
+        output += '\n';
+        // Defines have to follow #version, which has to come first
+        if (!defines.empty() && start != std::string::npos && line.compare(start, 8, "#version") == 0) {
+            for (const std::string& define : defines) output += "#define " + define + "\n";
+            output += "#line " + std::to_string(lineNumber + 1) + " " + fileIndex + "\n";
+        }
+    }
+    return true;
+}
+
+std::string preprocessShader(const std::string& path, const std::vector<std::string>& defines,
+    std::vector<std::string>& files, std::unordered_map<std::string, std::string>* sources) {
+    std::string output;
+    if (!expandIncludes(path, defines, output, files, sources)) return "";
+    return output;
+}
+
 unsigned int compileShader(GLenum type, const std::string& source) {
     unsigned int shader = glCreateShader(type);
     const char* src = source.c_str();
@@ -30,46 +89,405 @@ unsigned int compileShader(GLenum type, const std::string& source) {
     if (!success) {
         char infoLog[512];
         glGetShaderInfoLog(shader, 512, nullptr, infoLog);
-        std::cerr << "SHADER COMPILE ERROR (" << (type == GL_VERTEX_SHADER ? "VERTEX" : "FRAGMENT")
-            << "):\n" << infoLog << "\n";
-        logger.addLog(std::string("Shader compile error: ") + infoLog);
+        logger.addLog(LogLevel::Error, std::string("Shader compile error (") + (type == GL_VERTEX_SHADER ? "vertex" : "fragment")
+            + "): " + infoLog);
+        glDeleteShader(shader);
         return 0;
     }
     return shader;
 }
 
-unsigned int loadShader(const char* vertexPath, const char* fragmentPath) {
-    std::string vertexCode = readFile(vertexPath);
-    std::string fragmentCode = readFile(fragmentPath);
-    if (vertexCode.empty() || fragmentCode.empty()) return 0;
-    unsigned int vertex = compileShader(GL_VERTEX_SHADER, vertexCode);
-    unsigned int fragment = compileShader(GL_FRAGMENT_SHADER, fragmentCode);
-    if (!vertex || !fragment) return 0;
-    unsigned int program = glCreateProgram();
-    glAttachShader(program, vertex);
-    glAttachShader(program, fragment);
+unsigned int loadShader(const char* vertexPath, const char* fragmentPath, const std::vector<std::string>& defines) {
+    return shaderManager.load(vertexPath, fragmentPath, defines);
+}
+
+unsigned int loadTransformFeedbackShader(const char* vertexPath, const char* const* varyings, int varyingCount) {
+    return shaderManager.loadTransformFeedback(vertexPath, varyings, varyingCount);
+}
+
+static const uint64_t kHashBasis = 14695981039346656037ull;
+
+// FNV-1a, terminated so that consecutive strings cannot run into each other
+static void hashString(uint64_t& hash, const std::string& text) {
+    for (size_t i = 0; i <= text.size(); ++i) {
+        hash ^= static_cast<unsigned char>(text.c_str()[i]);
+        hash *= 1099511628211ull;
+    }
+}
+
+// On-disk layout of shader_cache/<source hash>.bin, followed by length bytes of binary
+struct ProgramBinaryHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceHash;
+    uint64_t driverHash;
+    uint32_t format;
+    uint32_t length;
+};
+static const char kBinaryMagic[4] = { 'G', 'S', 'P', 'B' };
+static const uint32_t kBinaryVersion = 1;
+
+ShaderManager::ShaderManager()
+    : cacheDirectory("shader_cache"), binaryChecked(false), binarySupported(false), driverHash(0) {}
+
+uint64_t ShaderManager::programHash(const std::string& vertexSource, const std::string& fragmentSource,
+    const std::vector<std::string>& varyings) {
+    uint64_t hash = kHashBasis;
+    hashString(hash, vertexSource);
+    hashString(hash, fragmentSource);
+    for (const std::string& varying : varyings) hashString(hash, varying);
+    return hash;
+}
+
+std::string ShaderManager::variantKey(const ProgramRecord& record) {
+    std::string key = record.vertexPath + "|" + record.fragmentPath;
+    for (const std::string& define : record.defines) key += "|D" + define;
+    for (const std::string& varying : record.varyings) key += "|V" + varying;
+    return key;
+}
+
+// Both stages of the record from the source cache, reading only files not seen before; a transform
+// feedback record has no fragment stage
+bool ShaderManager::preprocess(const ProgramRecord& record, std::string& vertexSource, std::string& fragmentSource,
+    std::vector<std::string>& files) {
+    files.clear();
+    vertexSource = preprocessShader(record.vertexPath, record.defines, files, &sources);
+    if (vertexSource.empty()) return false;
+    fragmentSource.clear();
+    if (record.fragmentPath.empty()) return true;
+    // Separate list: the fragment stage needs its own copy of includes the vertex stage pulled in
+    std::vector<std::string> fragmentFiles;
+    fragmentSource = preprocessShader(record.fragmentPath, record.defines, fragmentFiles, &sources);
+    for (const std::string& file : fragmentFiles) {
+        if (std::find(files.begin(), files.end(), file) == files.end()) files.push_back(file);
+    }
+    return !fragmentSource.empty();
+}
+
+unsigned int ShaderManager::load(const char* vertexPath, const char* fragmentPath, const std::vector<std::string>& defines) {
+    ProgramRecord record = {};
+    record.vertexPath = vertexPath;
+    record.fragmentPath = fragmentPath;
+    record.defines = defines;
+    return addProgram(record);
+}
+
+unsigned int ShaderManager::loadTransformFeedback(const char* vertexPath, const char* const* varyings, int varyingCount) {
+    ProgramRecord record = {};
+    record.vertexPath = vertexPath;
+    record.varyings.assign(varyings, varyings + varyingCount);
+    return addProgram(record);
+}
+
+// Program for the record's variant: already known, shared with identical sources, restored from
+// its binary or built
+unsigned int ShaderManager::addProgram(ProgramRecord& record) {
+    std::string key = variantKey(record);
+    auto known = variants.find(key);
+    if (known != variants.end()) return records[known->second].id;
+    TRACE_SCOPE("ShaderManager::addProgram");
+    if (!preprocess(record, record.vertexSource, record.fragmentSource, record.files)) return 0;
+    record.hash = programHash(record.vertexSource, record.fragmentSource, record.varyings);
+    auto existing = programs.find(record.hash);
+    if (existing != programs.end()) {
+        variants[key] = existing->second;
+        return records[existing->second].id;
+    }
+    // The binary carries the transform feedback varyings along with the code
+    record.id = loadBinary(record.hash);
+    if (!record.id) {
+        unsigned int vertex = getStage(GL_VERTEX_SHADER, record.vertexSource);
+        unsigned int fragment = record.fragmentPath.empty() ? 0 : getStage(GL_FRAGMENT_SHADER, record.fragmentSource);
+        if (!vertex || (!fragment && !record.fragmentPath.empty())) return 0;
+        unsigned int program = glCreateProgram();
+        glAttachShader(program, vertex);
+        if (fragment) glAttachShader(program, fragment);
+        if (!record.varyings.empty()) {
+            std::vector<const char*> names;
+            for (const std::string& varying : record.varyings) names.push_back(varying.c_str());
+            // Varyings have to be declared before linking
+            glTransformFeedbackVaryings(program, static_cast<GLsizei>(names.size()), names.data(), GL_INTERLEAVED_ATTRIBS);
+        }
+        if (!linkProgram(program, record.varyings.empty() ? "Shader" : "Transform feedback")) {
+            glDeleteProgram(program);
+            return 0;
+        }
+        int success = 1;
+        if (record.varyings.empty()) {
+            glValidateProgram(program);
+            glGetProgramiv(program, GL_VALIDATE_STATUS, &success);
+        }
+        if (!success) {
+            char infoLog[512];
+            glGetProgramInfoLog(program, 512, nullptr, infoLog);
+            logger.addLog(LogLevel::Error, std::string("Shader validation error: ") + infoLog);
+            glDeleteProgram(program);
+            return 0;
+        }
+        record.id = program;
+        saveBinary(record.hash, record.id);
+    }
+    programs[record.hash] = records.size();
+    variants[key] = records.size();
+    records.push_back(record);
+    return record.id;
+}
+
+void ShaderManager::release() {
+    watcher.stop();
+    for (auto& record : records) {
+        glDeleteProgram(record.id);
+        if (record.trialProgram) glDeleteProgram(record.trialProgram);
+    }
+    for (auto& entry : stages) glDeleteShader(entry.second);
+    records.clear();
+    programs.clear();
+    variants.clear();
+    stages.clear();
+    sources.clear();
+    reloadQueue.clear();
+}
+
+uint64_t ShaderManager::stageKey(GLenum type, const std::string& source) {
+    uint64_t key = kHashBasis ^ type;
+    hashString(key, source);
+    return key;
+}
+
+unsigned int ShaderManager::getStage(GLenum type, const std::string& source, bool* compiled) {
+    uint64_t key = stageKey(type, source);
+    auto existing = stages.find(key);
+    if (compiled) *compiled = existing == stages.end();
+    if (existing != stages.end()) return existing->second;
+    unsigned int shader = compileShader(type, source);
+    if (shader) stages[key] = shader;
+    return shader;
+}
+
+void ShaderManager::releaseStage(GLenum type, const std::string& source) {
+    auto existing = stages.find(stageKey(type, source));
+    if (existing == stages.end()) return;
+    for (const ProgramRecord& record : records) {
+        const std::string& current = type == GL_VERTEX_SHADER ? record.vertexSource : record.fragmentSource;
+        const std::string& next = type == GL_VERTEX_SHADER ? record.nextVertexSource : record.nextFragmentSource;
+        if (current == source || (record.reloadStep > 0 && next == source)) return;
+    }
+    // Linked programs keep their code; the shader object is only needed to link again
+    glDeleteShader(existing->second);
+    stages.erase(existing);
+}
+
+// Links the attached stages, then detaches them: they stay in the stage cache for the next
+// program that uses them
+bool ShaderManager::linkProgram(unsigned int program, const char* name) {
+    if (checkBinarySupport()) glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(program);
+    GLuint attached[2];
+    GLsizei attachedCount = 0;
+    glGetAttachedShaders(program, 2, &attachedCount, attached);
+    for (GLsizei i = 0; i < attachedCount; ++i) glDetachShader(program, attached[i]);
     int success;
     glGetProgramiv(program, GL_LINK_STATUS, &success);
     if (!success) {
         char infoLog[512];
         glGetProgramInfoLog(program, 512, nullptr, infoLog);
-        std::cerr << "SHADER LINK ERROR:\n" << infoLog << "\n";
-        logger.addLog(std::string("Shader link error: ") + infoLog);
-        glDeleteProgram(program);
-        return 0;
+        logger.addLog(LogLevel::Error, std::string(name) + " link error: " + infoLog);
+        return false;
+    }
+    return true;
+}
+
+bool ShaderManager::enableHotReload(const std::string& directory) {
+    return watcher.start(directory);
+}
+
+void ShaderManager::update() {
+    if (!watcher.isRunning()) return;
+    watcher.takeChanges(changes);
+    for (auto& change : changes) {
+        bool used = false;
+        for (size_t i = 0; i < records.size(); ++i) {
+            ProgramRecord& record = records[i];
+            if (std::find(record.files.begin(), record.files.end(), change.first) == record.files.end()) continue;
+            used = true;
+            bool queued = record.reloadStep > 0;
+            // A change arriving mid-reload restarts it with the newer sources
+            if (record.trialProgram) glDeleteProgram(record.trialProgram);
+            record.trialProgram = 0;
+            record.reloadStep = 1;
+            if (!queued) reloadQueue.push_back(i);
+        }
+        if (used) sources[change.first] = std::move(change.second);
+    }
+    while (!reloadQueue.empty()) {
+        ProgramRecord& record = records[reloadQueue.front()];
+        bool didWork = stepReload(record);
+        if (record.reloadStep == 0) reloadQueue.pop_front();
+        if (didWork) break;
+    }
+}
+
+// Advances a reload by one step; true if the step compiled or linked something (the frame's
+// budget). reloadStep drops to 0 when the reload has finished or given up.
+bool ShaderManager::stepReload(ProgramRecord& record) {
+    std::string name = record.vertexPath + (record.fragmentPath.empty() ? "" : " + " + record.fragmentPath);
+    bool compiled = false;
+    switch (record.reloadStep) {
+    case 1:
+        // Changed files are already in sources; only an include added by the edit is read from disk
+        if (!preprocess(record, record.nextVertexSource, record.nextFragmentSource, record.nextFiles)) {
+            record.reloadStep = -1;
+            break;
+        }
+        if (record.nextVertexSource == record.vertexSource && record.nextFragmentSource == record.fragmentSource) {
+            record.reloadStep = 0;
+            return false;
+        }
+        record.nextVertexStage = getStage(GL_VERTEX_SHADER, record.nextVertexSource, &compiled);
+        record.reloadStep = record.nextVertexStage ? 2 : -1;
+        break;
+    case 2:
+        record.nextFragmentStage = 0;
+        if (!record.fragmentPath.empty()) {
+            record.nextFragmentStage = getStage(GL_FRAGMENT_SHADER, record.nextFragmentSource, &compiled);
+            if (!record.nextFragmentStage) {
+                record.reloadStep = -1;
+                break;
+            }
+        }
+        record.reloadStep = 3;
+        break;
+    case 3:
+    case 4: {
+        // Link into a scratch program first; the live one is only relinked once that worked, so
+        // a broken edit never leaves it without an executable
+        unsigned int program = record.reloadStep == 3 ? glCreateProgram() : record.id;
+        glAttachShader(program, record.nextVertexStage);
+        if (record.nextFragmentStage) glAttachShader(program, record.nextFragmentStage);
+        if (!record.varyings.empty()) {
+            std::vector<const char*> names;
+            for (const std::string& varying : record.varyings) names.push_back(varying.c_str());
+            glTransformFeedbackVaryings(program, static_cast<GLsizei>(names.size()), names.data(), GL_INTERLEAVED_ATTRIBS);
+        }
+        bool linked = linkProgram(program, name.c_str());
+        compiled = true;
+        if (record.reloadStep == 3) {
+            record.trialProgram = program;
+            record.reloadStep = linked ? 4 : -1;
+            break;
+        }
+        glDeleteProgram(record.trialProgram);
+        record.trialProgram = 0;
+        if (!linked) {
+            record.reloadStep = -1;
+            break;
+        }
+        size_t index = programs[record.hash];
+        programs.erase(record.hash);
+        // The next* fields are left holding the replaced sources, whose stages go unless shared
+        std::swap(record.vertexSource, record.nextVertexSource);
+        std::swap(record.fragmentSource, record.nextFragmentSource);
+        record.files.swap(record.nextFiles);
+        record.hash = programHash(record.vertexSource, record.fragmentSource, record.varyings);
+        programs.emplace(record.hash, index);
+        saveBinary(record.hash, record.id);
+        logger.addLog("Reloaded " + name + ".");
+        record.reloadStep = 0;
+        releaseStage(GL_VERTEX_SHADER, record.nextVertexSource);
+        releaseStage(GL_FRAGMENT_SHADER, record.nextFragmentSource);
+        return true;
     }
-    glValidateProgram(program);
-    glGetProgramiv(program, GL_VALIDATE_STATUS, &success);
+    }
+    if (record.reloadStep < 0) {
+        if (record.trialProgram) glDeleteProgram(record.trialProgram);
+        record.trialProgram = 0;
+        logger.addLog(LogLevel::Warning, "Reload of " + name + " failed, keeping the previous program.");
+        record.reloadStep = 0;
+        // A stage that compiled for the broken edit would otherwise stay cached for good
+        releaseStage(GL_VERTEX_SHADER, record.nextVertexSource);
+        releaseStage(GL_FRAGMENT_SHADER, record.nextFragmentSource);
+    }
+    return compiled;
+}
+
+bool ShaderManager::checkBinarySupport() {
+    if (binaryChecked) return binarySupported;
+    binaryChecked = true;
+    // Without 4.1 or the extension glad leaves these null, and querying the format count would be
+    // an invalid enum
+    GLint formats = 0;
+    if (glad_glGetProgramBinary && glad_glProgramBinary && glad_glProgramParameteri)
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    if (formats <= 0) {
+        logger.addLog(LogLevel::Warning, "Program binaries not supported by this context, shaders compile on every start.");
+        return false;
+    }
+    driverHash = kHashBasis;
+    const GLenum strings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION };
+    for (GLenum name : strings) {
+        const char* value = reinterpret_cast<const char*>(glGetString(name));
+        hashString(driverHash, value ? value : "");
+    }
+    std::error_code error;
+    std::filesystem::create_directories(cacheDirectory, error);
+    binarySupported = true;
+    return true;
+}
+
+std::string ShaderManager::binaryPath(uint64_t hash) const {
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.bin", static_cast<unsigned long long>(hash));
+    return cacheDirectory + name;
+}
+
+unsigned int ShaderManager::loadBinary(uint64_t hash) {
+    if (!checkBinarySupport()) return 0;
+    FILE* file = fopen(binaryPath(hash).c_str(), "rb");
+    if (!file) return 0;
+    ProgramBinaryHeader header;
+    std::vector<char> binary;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, kBinaryMagic, 4) == 0
+        && header.version == kBinaryVersion && header.sourceHash == hash && header.length > 0;
+    // A driver update invalidates every binary; they are rewritten as programs get recompiled
+    ok = ok && header.driverHash == driverHash;
+    if (ok) {
+        binary.resize(header.length);
+        ok = fread(binary.data(), 1, binary.size(), file) == binary.size();
+    }
+    fclose(file);
+    if (!ok) return 0;
+    unsigned int program = glCreateProgram();
+    glProgramBinary(program, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+    int success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
     if (!success) {
-        char infoLog[512];
-        glGetProgramInfoLog(program, 512, nullptr, infoLog);
-        std::cerr << "SHADER VALIDATION ERROR:\n" << infoLog << "\n";
-        logger.addLog(std::string("Shader validation error: ") + infoLog);
+        logger.addLog(LogLevel::Warning, "Program binary " + binaryPath(hash) + " rejected by the driver, recompiling.");
         glDeleteProgram(program);
         return 0;
     }
-    glDeleteShader(vertex);
-    glDeleteShader(fragment);
     return program;
 }
+
+void ShaderManager::saveBinary(uint64_t hash, unsigned int program) {
+    if (!binarySupported) return;
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+    ProgramBinaryHeader header;
+    memcpy(header.magic, kBinaryMagic, 4);
+    header.version = kBinaryVersion;
+    header.sourceHash = hash;
+    header.driverHash = driverHash;
+    std::vector<char> binary(length);
+    GLsizei written = 0;
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &written, &format, binary.data());
+    if (written <= 0) return;
+    header.format = format;
+    header.length = static_cast<uint32_t>(written);
+    std::string path = binaryPath(hash);
+    FILE* file = fopen(path.c_str(), "wb");
+    bool ok = file && fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(binary.data(), 1, written, file) == static_cast<size_t>(written);
+    if (file) fclose(file);
+    if (!ok) logger.addLog(LogLevel::Warning, "Failed to write program binary: " + path);
+}
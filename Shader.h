@@ -1,18 +1,105 @@
 // Shader.h
 #pragma once
+#include "FileWatcher.h"
+#include <cstdint>
+#include <deque>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #include <glad/glad.h>
 
 std::string readFile(const char* path);
+// Source of path with every #include "file" expanded (relative to the including file, each file
+// once; conditionals are not evaluated) and defines inserted after #version. #line directives
+// keep compile errors pointing at the right line; the source string number is the file's index
+// in files, which receives every file read, path first. Files found in sources are not read from
+// disk; the ones that are get added to it. Empty on failure.
+std::string preprocessShader(const std::string& path, const std::vector<std::string>& defines,
+    std::vector<std::string>& files, std::unordered_map<std::string, std::string>* sources = nullptr);
 unsigned int compileShader(GLenum type, const std::string& source);
-unsigned int loadShader(const char* vertexPath, const char* fragmentPath);
+// Both go through shaderManager; defines select a variant of the pair
+unsigned int loadShader(const char* vertexPath, const char* fragmentPath, const std::vector<std::string>& defines = {});
+// Vertex-only program whose outputs are captured interleaved by transform feedback
+unsigned int loadTransformFeedbackShader(const char* vertexPath, const char* const* varyings, int varyingCount);
+
+// Owns every program of the application. A variant (paths, defines, varyings) is preprocessed and
+// built the first time it is asked for and returned directly afterwards. Programs are keyed by a
+// hash of their preprocessed sources (and transform feedback varyings): the same sources always
+// give the same program, and compiled stages are shared between programs. Linked programs are written to cacheDirectory and
+// restored with glProgramBinary on the next start while the driver (vendor, renderer, version) is
+// unchanged; a missing, stale or rejected binary falls back to compiling. Program binaries are GL
+// 4.1 / ARB_get_program_binary, beyond the 3.3 context we ask for, so their entry points are
+// checked at runtime.
+class ShaderManager {
+public:
+    ShaderManager();
+    unsigned int load(const char* vertexPath, const char* fragmentPath, const std::vector<std::string>& defines = {});
+    unsigned int loadTransformFeedback(const char* vertexPath, const char* const* varyings, int varyingCount);
+    // Hot reload: programs whose source or included files change in directory are rebuilt in place (same
+    // program name, so callers keep their IDs; uniforms reset to their defaults). update() does at
+    // most one compile or link per call and no file I/O: changed files arrive with their contents
+    // from the watcher, the rest come from the sources read at load. A program that fails to build
+    // keeps running the previous version.
+    bool enableHotReload(const std::string& directory);
+    void update();      // once per frame, GL thread
+    // Deletes every program and stage; call on the GL thread before the context goes away
+    void release();
+    std::string cacheDirectory;
+    size_t getProgramCount() const { return records.size(); }
+private:
+    struct ProgramRecord {
+        unsigned int id;
+        uint64_t hash;
+        std::string vertexPath, fragmentPath;   // fragmentPath empty for transform feedback
+        std::vector<std::string> defines;
+        std::vector<std::string> varyings;
+        std::vector<std::string> files;         // both stages with their includes
+        std::string vertexSource, fragmentSource;  // preprocessed
+        // Reload in progress: preprocess and compile vertex, compile fragment, link a trial
+        // program, relink id
+        std::vector<std::string> nextFiles;
+        std::string nextVertexSource, nextFragmentSource;
+        unsigned int nextVertexStage, nextFragmentStage;
+        unsigned int trialProgram;
+        int reloadStep;
+    };
+    std::vector<ProgramRecord> records;
+    std::unordered_map<uint64_t, size_t> programs;          // source hash -> record
+    std::unordered_map<std::string, size_t> variants;       // paths, defines and varyings -> record
+    std::unordered_map<uint64_t, unsigned int> stages;     // stage type and source hash -> shader object
+    std::unordered_map<std::string, std::string> sources;  // path -> contents of every file preprocessed
+    FileWatcher watcher;
+    std::vector<std::pair<std::string, std::string>> changes;
+    std::deque<size_t> reloadQueue;
+    bool binaryChecked;
+    bool binarySupported;
+    uint64_t driverHash;
+    static uint64_t programHash(const std::string& vertexSource, const std::string& fragmentSource,
+        const std::vector<std::string>& varyings);
+    static uint64_t stageKey(GLenum type, const std::string& source);
+    unsigned int getStage(GLenum type, const std::string& source, bool* compiled = nullptr);
+    // Deletes the cached stage for source unless a program or a reload in progress still uses it
+    void releaseStage(GLenum type, const std::string& source);
+    static std::string variantKey(const ProgramRecord& record);
+    bool preprocess(const ProgramRecord& record, std::string& vertexSource, std::string& fragmentSource,
+        std::vector<std::string>& files);
+    unsigned int addProgram(ProgramRecord& record);
+    bool linkProgram(unsigned int program, const char* name);
+    bool stepReload(ProgramRecord& record);
+    bool checkBinarySupport();
+    std::string binaryPath(uint64_t hash) const;
+    unsigned int loadBinary(uint64_t hash);
+    void saveBinary(uint64_t hash, unsigned int program);
+};
+extern ShaderManager shaderManager;
 
 class Shader {
 public:
     unsigned int ID;
     Shader() : ID(0) {}
-    Shader(const char* vertexPath, const char* fragmentPath) {
-        ID = loadShader(vertexPath, fragmentPath);
+    Shader(const char* vertexPath, const char* fragmentPath, const std::vector<std::string>& defines = {}) {
+        ID = loadShader(vertexPath, fragmentPath, defines);
     }
     void use() const {
         glUseProgram(ID);
@@ -0,0 +1,173 @@
+// SimulationCore.cpp
+#include "SimulationCore.h"
+#include "Globals.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <initializer_list>
+
+// Helper functions for vertex operations
+static float computeArea(const Vertex& v0, const Vertex& v1, const Vertex& v2) {
+    glm::vec3 a = v1.Position - v0.Position;
+    glm::vec3 b = v2.Position - v0.Position;
+    return 0.5f * glm::length(glm::cross(a, b));
+}
+
+static Vertex midpoint(const Vertex& v0, const Vertex& v1) {
+    Vertex m;
+    m.Position = (v0.Position + v1.Position) * 0.5f;
+    m.Normal = glm::normalize(v0.Normal + v1.Normal);
+    return m;
+}
+
+// Recursively subdivide a triangle into smaller triangles below the area threshold
+static void subdivideTriangle(const Vertex& v0, const Vertex& v1, const Vertex& v2, float areaThreshold,
+    std::mt19937& rng, std::vector<Vertex>& out) {
+    if (computeArea(v0, v1, v2) <= areaThreshold) {
+        // Add random perturbation in [-0.005, 0.005]
+        for (Vertex v : { v0, v1, v2 }) {
+            v.Position.x += (rng() / 4294967295.0f) * 0.01f - 0.005f;
+            v.Position.y += (rng() / 4294967295.0f) * 0.01f - 0.005f;
+            v.Position.z += (rng() / 4294967295.0f) * 0.01f - 0.005f;
+            out.push_back(v);
+        }
+        return;
+    }
+    Vertex m0 = midpoint(v0, v1);
+    Vertex m1 = midpoint(v1, v2);
+    Vertex m2 = midpoint(v2, v0);
+    subdivideTriangle(v0, m0, m2, areaThreshold, rng, out);
+    subdivideTriangle(m0, v1, m1, areaThreshold, rng, out);
+    subdivideTriangle(m2, m1, v2, areaThreshold, rng, out);
+    subdivideTriangle(m0, m1, m2, areaThreshold, rng, out);
+}
+
+FractureTemplateCache::FractureTemplateCache(const std::vector<Mesh>& sourceMeshes) : sourceMeshes(sourceMeshes) {}
+
+FractureTemplateCache::~FractureTemplateCache() {
+    for (auto& entry : templates) {
+        delete entry.second;
+    }
+}
+
+const FractureTemplate& FractureTemplateCache::get(float areaThreshold) {
+    std::lock_guard<std::mutex> lock(mutex);
+    FractureTemplate*& entry = templates[areaThreshold];
+    if (entry) return *entry;
+    TRACE_SCOPE("FractureTemplateCache::build");
+    entry = new FractureTemplate();
+    entry->areaThreshold = areaThreshold;
+    // Fixed seed: the perturbation is part of the template, not of a run
+    std::mt19937 rng(0x9e3779b9u);
+    for (const auto& mesh : sourceMeshes) {
+        for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+            subdivideTriangle(mesh.vertices[mesh.indices[i]], mesh.vertices[mesh.indices[i + 1]],
+                mesh.vertices[mesh.indices[i + 2]], areaThreshold, rng, entry->triangles);
+        }
+    }
+    const std::vector<Vertex>& triangles = entry->triangles;
+    entry->bounds.resize(entry->getFragmentCount());
+    for (size_t f = 0; f < entry->bounds.size(); ++f) {
+        const Vertex* v = &triangles[f * 3];
+        glm::vec3 centroid = (v[0].Position + v[1].Position + v[2].Position) / 3.0f;
+        float radius = std::max(glm::length(v[0].Position - centroid),
+            std::max(glm::length(v[1].Position - centroid), glm::length(v[2].Position - centroid)));
+        entry->bounds[f] = glm::vec4(centroid, radius);
+    }
+    return *entry;
+}
+
+SimulationCore::SimulationCore(FractureTemplateCache& templates) : templates(templates), fractureTemplate(nullptr) {
+    reset(SimulationParams());
+}
+
+void SimulationCore::reset(const SimulationParams& newParams) {
+    params = newParams;
+    state = State::FALLING;
+    simulationTime = 0.0f;
+    glassPosition = glm::vec3(0.0f, params.fallHeight, 0.0f);
+    fragments.clear();
+    fractureTemplate = nullptr;
+    rng.seed(params.seed);
+}
+
+void SimulationCore::setAreaThreshold(float areaThreshold) {
+    if (state == State::FALLING) params.areaThreshold = areaThreshold;
+}
+
+// mt19937 output is fully specified by the standard, unlike the <random> distributions,
+// so values derived from it directly are reproducible across standard libraries
+float SimulationCore::randomPercent() {
+    return (rng() % 100) / 100.0f;
+}
+
+void SimulationCore::fracture() {
+    TRACE_SCOPE("SimulationCore::fracture");
+    fractureTemplate = &templates.get(params.areaThreshold);
+    fragments.resize(fractureTemplate->getFragmentCount());
+    for (auto& frag : fragments) {
+        frag.position = glassPosition;
+        float speed = randomPercent() * 5.0f;
+        float angleRad = glm::radians(params.impactAngle + ((static_cast<int>(rng() % 50)) - 25) * 0.1f);
+        frag.velocity = glm::vec3(speed * cos(angleRad),
+            speed * sin(angleRad),
+            randomPercent() * 5.0f);
+        frag.rotationAxis = glm::normalize(glm::vec3(randomPercent(), randomPercent(), randomPercent()));
+        frag.rotationAngle = 0.0f;
+        frag.angularVelocity = randomPercent() * 90.0f;
+    }
+}
+
+void SimulationCore::update(float dt) {
+    simulationTime += dt;
+    if (state == State::FALLING) {
+        float displacement = 0.5f * gravity * simulationTime * simulationTime;
+        glassPosition.y = params.fallHeight - displacement;
+        if (glassPosition.y <= 0.0f) {
+            glassPosition.y = 0.0f;
+            state = State::SHATTERED;
+            fracture();
+        }
+    }
+    else if (state == State::SHATTERED) {
+        bool allStopped = true;
+        for (auto& frag : fragments) {
+            if (glm::length(frag.velocity) > 0.05f)
+                allStopped = false;
+            frag.velocity.y -= gravity * dt;
+            frag.position += frag.velocity * dt;
+            frag.rotationAngle += frag.angularVelocity * dt;
+            if (frag.position.y < 0.0f) {
+                frag.position.y = 0.0f;
+                frag.velocity.y = -frag.velocity.y * restitution;
+                frag.velocity.x *= friction;
+                frag.velocity.z *= friction;
+                frag.angularVelocity *= friction;
+            }
+        }
+        if (allStopped) state = State::SIMULATION_DONE;
+    }
+}
+
+static void hashBytes(uint64_t& hash, const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+}
+
+uint64_t SimulationCore::stateHash() const {
+    uint64_t hash = 14695981039346656037ull;
+    int stateValue = static_cast<int>(state);
+    hashBytes(hash, &stateValue, sizeof(stateValue));
+    hashBytes(hash, &simulationTime, sizeof(simulationTime));
+    hashBytes(hash, &glassPosition, sizeof(glassPosition));
+    for (const auto& frag : fragments) {
+        hashBytes(hash, &frag.position, sizeof(frag.position));
+        hashBytes(hash, &frag.velocity, sizeof(frag.velocity));
+        hashBytes(hash, &frag.rotationAngle, sizeof(frag.rotationAngle));
+        hashBytes(hash, &frag.angularVelocity, sizeof(frag.angularVelocity));
+    }
+    return hash;
+}
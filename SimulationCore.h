@@ -0,0 +1,84 @@
+// SimulationCore.h
+#pragma once
+#include "Mesh.h"
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <random>
+#include <vector>
+
+struct FragmentSim {
+    glm::vec3 position;
+    glm::vec3 velocity;
+    glm::vec3 rotationAxis;
+    float rotationAngle;
+    float angularVelocity;
+};
+
+// Fragment triangles of a model fractured down to one area threshold. The subdivision is the same
+// for every glass, so it is built once and shared; cores only own per-fragment motion.
+struct FractureTemplate {
+    float areaThreshold;
+    std::vector<Vertex> triangles;  // 3 per fragment, model space, fragment i uses [3i, 3i + 3)
+    std::vector<glm::vec4> bounds;  // per fragment: centroid (xyz) and the radius around it (w)
+    size_t getFragmentCount() const { return triangles.size() / 3; }
+};
+
+// Builds templates on first use and keeps them for the lifetime of the cache. Thread-safe, so the
+// batch sweep workers can share one. Source geometry must outlive the cache.
+class FractureTemplateCache {
+public:
+    explicit FractureTemplateCache(const std::vector<Mesh>& sourceMeshes);
+    ~FractureTemplateCache();
+    const FractureTemplate& get(float areaThreshold);
+    const std::vector<Mesh>& getSourceMeshes() const { return sourceMeshes; }
+private:
+    const std::vector<Mesh>& sourceMeshes;
+    std::mutex mutex;
+    std::map<float, FractureTemplate*> templates;
+};
+
+struct SimulationParams {
+    float fallHeight = 10.0f;
+    float impactAngle = 45.0f;
+    float areaThreshold = 0.005f;   // selects the fracture template: triangles are subdivided down to this area
+    uint32_t seed = 1;
+};
+
+// Fall, fracture and fragment physics without any GL state. Given the same params and the same
+// sequence of dt values it produces bit-identical results, which record/replay relies on.
+class SimulationCore {
+public:
+    enum class State { FALLING, SHATTERED, SIMULATION_DONE };
+    // Fracture templates are shared read-only and the cache must outlive the core
+    explicit SimulationCore(FractureTemplateCache& templates);
+    void reset(const SimulationParams& params);
+    void update(float dt);
+    // Fracture density can be chosen late: the threshold is only read when the glass hits the
+    // floor, so changing it while FALLING does not perturb anything else. Ignored afterwards.
+    void setAreaThreshold(float areaThreshold);
+    State getState() const { return state; }
+    const SimulationParams& getParams() const { return params; }
+    const std::vector<FragmentSim>& getFragments() const { return fragments; }
+    // Geometry for getFragments(), index for index; null until the glass has shattered
+    const FractureTemplate* getTemplate() const { return fractureTemplate; }
+    const glm::vec3& getGlassPosition() const { return glassPosition; }
+    float getSimulationTime() const { return simulationTime; }
+    // FNV-1a over the raw bits of the simulation state
+    uint64_t stateHash() const;
+private:
+    FractureTemplateCache& templates;
+    const FractureTemplate* fractureTemplate;
+    SimulationParams params;
+    State state;
+    float simulationTime;
+    glm::vec3 glassPosition;
+    std::vector<FragmentSim> fragments;
+    std::mt19937 rng;
+    float randomPercent();
+    void fracture();
+    const float gravity = 9.81f;
+    const float restitution = 0.5f;
+    const float friction = 0.8f;
+};
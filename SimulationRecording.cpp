@@ -0,0 +1,79 @@
+// SimulationRecording.cpp
+#include "SimulationRecording.h"
+#include "Globals.h"
+#include <fstream>
+
+// Little-endian binary layout: magic, version, seed, fallHeight, impactAngle, areaThreshold,
+// frame count, dt per frame, final state hash
+static const char kMagic[4] = { 'G', 'S', 'R', 'C' };
+// Version 2: fracture geometry comes from a shared template, which changed the rng sequence
+static const uint32_t kVersion = 2;
+
+template <typename T>
+static void writeValue(std::ofstream& file, const T& value) {
+    file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+static bool readValue(std::ifstream& file, T& value) {
+    return static_cast<bool>(file.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+bool SimulationRecording::save(const std::string& path) const {
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        logger.addLog(LogLevel::Error, "Failed to write recording: " + path);
+        return false;
+    }
+    file.write(kMagic, sizeof(kMagic));
+    writeValue(file, kVersion);
+    writeValue(file, params.seed);
+    writeValue(file, params.fallHeight);
+    writeValue(file, params.impactAngle);
+    writeValue(file, params.areaThreshold);
+    writeValue(file, static_cast<uint32_t>(frameDts.size()));
+    file.write(reinterpret_cast<const char*>(frameDts.data()), frameDts.size() * sizeof(float));
+    writeValue(file, finalHash);
+    return static_cast<bool>(file);
+}
+
+bool SimulationRecording::load(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    char magic[4];
+    uint32_t version = 0;
+    uint32_t frameCount = 0;
+    if (!file.is_open() || !file.read(magic, sizeof(magic)) || std::string(magic, 4) != std::string(kMagic, 4)
+        || !readValue(file, version) || version != kVersion) {
+        logger.addLog(LogLevel::Error, "Not a simulation recording: " + path);
+        return false;
+    }
+    bool ok = readValue(file, params.seed) && readValue(file, params.fallHeight) && readValue(file, params.impactAngle)
+        && readValue(file, params.areaThreshold) && readValue(file, frameCount);
+    if (ok) {
+        // The count is untrusted: it has to fit in what is left of the file before anything is allocated
+        std::streamoff position = file.tellg();
+        file.seekg(0, std::ios::end);
+        std::streamoff remaining = file.tellg() - position;
+        file.seekg(position);
+        ok = static_cast<uint64_t>(frameCount) * sizeof(float) + sizeof(finalHash) <= static_cast<uint64_t>(remaining);
+    }
+    if (ok) {
+        frameDts.resize(frameCount);
+        ok = static_cast<bool>(file.read(reinterpret_cast<char*>(frameDts.data()), frameCount * sizeof(float)))
+            && readValue(file, finalHash);
+    }
+    if (!ok) logger.addLog(LogLevel::Error, "Truncated simulation recording: " + path);
+    return ok;
+}
+
+bool replayHeadless(const SimulationRecording& recording, const std::vector<Mesh>& sourceMeshes, uint64_t* replayHash) {
+    TRACE_SCOPE("replayHeadless");
+    FractureTemplateCache templates(sourceMeshes);
+    SimulationCore core(templates);
+    core.reset(recording.params);
+    for (float dt : recording.frameDts)
+        core.update(dt);
+    uint64_t hash = core.stateHash();
+    if (replayHash) *replayHash = hash;
+    return hash == recording.finalHash;
+}
@@ -0,0 +1,19 @@
+// SimulationRecording.h
+#pragma once
+#include "SimulationCore.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Everything needed to reproduce a run: the core parameters (including the seed) and every dt
+// the core was stepped with. finalHash lets a replay prove it reached the identical state.
+struct SimulationRecording {
+    SimulationParams params;
+    std::vector<float> frameDts;
+    uint64_t finalHash = 0;
+    bool save(const std::string& path) const;
+    bool load(const std::string& path);
+};
+
+// Steps a fresh core through the recording; returns true when the final state hash matches
+bool replayHeadless(const SimulationRecording& recording, const std::vector<Mesh>& sourceMeshes, uint64_t* replayHash = nullptr);
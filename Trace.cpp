@@ -0,0 +1,101 @@
+// Trace.cpp
+#include "Trace.h"
+#include "Globals.h"
+#include <fstream>
+
+TraceRecorder::TraceRecorder() : enabled(true), epoch(std::chrono::steady_clock::now()), dropped(0) {}
+
+long long TraceRecorder::now() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+TraceRecorder::ThreadOwner::~ThreadOwner() {
+    if (!buffer) return;
+    std::lock_guard<std::mutex> lock(recorder->registryMutex);
+    recorder->freeBuffers.push_back(buffer);
+}
+
+TraceRecorder::ThreadBuffer* TraceRecorder::threadBuffer() {
+    // Buffers are owned by the recorder so events survive worker threads exiting
+    thread_local ThreadOwner owner;
+    if (!owner.buffer && !owner.denied) {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        if (!freeBuffers.empty()) {
+            owner.buffer = freeBuffers.back();
+            freeBuffers.pop_back();
+        }
+        else if (buffers.size() < kMaxThreadBuffers) {
+            buffers.push_back(std::make_unique<ThreadBuffer>());
+            owner.buffer = buffers.back().get();
+            owner.buffer->threadId = static_cast<unsigned int>(buffers.size());
+        }
+        else {
+            owner.denied = true;
+        }
+        owner.recorder = this;
+    }
+    return owner.buffer;
+}
+
+void TraceRecorder::record(const char* name, long long startNs, long long endNs) {
+    if (!enabled.load(std::memory_order_relaxed)) return;
+    ThreadBuffer* buffer = threadBuffer();
+    if (!buffer) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    // Single producer per buffer: the owning thread. Oldest events are overwritten.
+    size_t index = buffer->written.load(std::memory_order_relaxed);
+    Event& event = buffer->events[index % kEventsPerThread];
+    event.sequence.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    event.name.store(name, std::memory_order_relaxed);
+    event.startNs.store(startNs, std::memory_order_relaxed);
+    event.durationNs.store(endNs - startNs, std::memory_order_relaxed);
+    event.sequence.store(2 * index + 2, std::memory_order_release);
+    buffer->written.store(index + 1, std::memory_order_release);
+}
+
+bool TraceRecorder::dump(const std::string& path) {
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        logger.addLog(LogLevel::Error, "Failed to write trace: " + path);
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(registryMutex);
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    size_t total = 0;
+    for (auto& buffer : buffers) {
+        size_t written = buffer->written.load(std::memory_order_acquire);
+        size_t begin = written > kEventsPerThread ? written - kEventsPerThread : 0;
+        for (size_t i = begin; i < written; ++i) {
+            // The owner keeps recording: copy the slot, then keep it only if its sequence still
+            // says event i, complete, before and after the copy
+            const Event& event = buffer->events[i % kEventsPerThread];
+            size_t sequence = event.sequence.load(std::memory_order_acquire);
+            if (sequence != 2 * i + 2) continue;
+            const char* name = event.name.load(std::memory_order_relaxed);
+            long long startNs = event.startNs.load(std::memory_order_relaxed);
+            long long durationNs = event.durationNs.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (event.sequence.load(std::memory_order_relaxed) != sequence) continue;
+            file << (first ? "" : ",\n") << "{\"name\":\"" << name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+                << buffer->threadId << ",\"ts\":" << startNs / 1000.0 << ",\"dur\":" << durationNs / 1000.0 << "}";
+            first = false;
+            total++;
+        }
+    }
+    file << "\n]}\n";
+    size_t lost = dropped.load(std::memory_order_relaxed);
+    logger.addLog("Trace with " + std::to_string(total) + " events written to " + path
+        + (lost ? " (" + std::to_string(lost) + " events dropped, more than " + std::to_string(kMaxThreadBuffers)
+            + " threads recording)" : ""));
+    return true;
+}
+
+TraceScope::TraceScope(const char* name) : name(name), startNs(tracer.now()) {}
+
+TraceScope::~TraceScope() {
+    tracer.record(name, startNs, tracer.now());
+}
@@ -0,0 +1,65 @@
+// Trace.h
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Records timed scopes into per-thread ring buffers and dumps them as Chrome trace-event JSON
+// (loadable in chrome://tracing or ui.perfetto.dev). Recording never locks; only the first
+// event of each thread takes the registry mutex. A buffer goes back to a free list when its thread
+// exits and the next new thread takes it over, events and track id included, so short-lived
+// threads reuse buffers instead of adding one each. At most kMaxThreadBuffers threads record at
+// once (about 2 MB each); events of threads beyond that are dropped and counted in the dump.
+class TraceRecorder {
+public:
+    TraceRecorder();
+    void record(const char* name, long long startNs, long long endNs);
+    long long now() const;
+    bool dump(const std::string& path);
+    std::atomic<bool> enabled;
+private:
+    static const size_t kEventsPerThread = 1 << 16;
+    static const size_t kMaxThreadBuffers = 64;
+    // Per-slot seqlock: sequence is odd while the owner writes the slot and 2 * (index + 1) once
+    // event index is complete, so dump() can tell a torn or overwritten copy and drop it
+    struct Event {
+        std::atomic<size_t> sequence{ 0 };
+        std::atomic<const char*> name{ nullptr };   // must be a string literal or otherwise outlive the recorder
+        std::atomic<long long> startNs{ 0 };
+        std::atomic<long long> durationNs{ 0 };
+    };
+    struct ThreadBuffer {
+        unsigned int threadId;
+        std::atomic<size_t> written{ 0 };
+        std::vector<Event> events = std::vector<Event>(kEventsPerThread);
+    };
+    std::chrono::steady_clock::time_point epoch;
+    // Thread-local handle that gives the thread's buffer back when the thread exits
+    struct ThreadOwner {
+        TraceRecorder* recorder = nullptr;
+        ThreadBuffer* buffer = nullptr;
+        bool denied = false;    // registry was full when the thread first recorded
+        ~ThreadOwner();
+    };
+    std::mutex registryMutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    std::vector<ThreadBuffer*> freeBuffers;     // owned by buffers, no thread attached
+    std::atomic<size_t> dropped;
+    ThreadBuffer* threadBuffer();
+};
+
+class TraceScope {
+public:
+    explicit TraceScope(const char* name);
+    ~TraceScope();
+private:
+    const char* name;
+    long long startNs;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
@@ -0,0 +1,499 @@
+// Trajectory.cpp
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "Trajectory.h"
+#include "Globals.h"
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+// File layout (little-endian):
+//   header  "GSTJ", version, fragment count, frames per chunk, position scale, angle scale,
+//           per fragment: rotation axis (3 floats) + triangle (3 x position/normal floats)
+//   chunks  frame count, frame times, then per fragment and component: zigzag varint keyframe,
+//           bit width, bit-packed residuals (first-order for frame 1, second-order after)
+//   index   per chunk: file offset (u64), first frame, frame count
+//   footer  chunk count, index offset (u64), "GSTI"
+static const char kHeaderMagic[4] = { 'G', 'S', 'T', 'J' };
+static const char kFooterMagic[4] = { 'G', 'S', 'T', 'I' };
+static const uint32_t kTrajectoryVersion = 1;
+static const size_t kFooterSize = 4 + 8 + 4;
+
+template <typename T>
+static void writeValue(std::ostream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+static void appendValue(std::vector<uint8_t>& out, const T& value) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+static uint32_t zigzag(int32_t v) {
+    return (static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31);
+}
+
+static int32_t unzigzag(uint32_t v) {
+    return static_cast<int32_t>(v >> 1) ^ -static_cast<int32_t>(v & 1);
+}
+
+static void appendVarint(std::vector<uint8_t>& out, uint32_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<uint8_t>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(v));
+}
+
+// Minimal bounds-checked cursor over a byte buffer
+struct ByteCursor {
+    const uint8_t* p;
+    const uint8_t* end;
+    bool ok = true;
+    template <typename T>
+    T read() {
+        T value{};
+        if (end - p < static_cast<ptrdiff_t>(sizeof(T))) {
+            ok = false;
+            return value;
+        }
+        memcpy(&value, p, sizeof(T));
+        p += sizeof(T);
+        return value;
+    }
+    uint32_t readVarint() {
+        uint32_t value = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+            if (p >= end) {
+                ok = false;
+                return 0;
+            }
+            uint8_t byte = *p++;
+            value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return value;
+        }
+        ok = false;
+        return value;
+    }
+};
+
+// Arithmetic is done modulo 2^32 on both sides, so any int32 sequence round-trips exactly
+static int32_t predictionResidual(const int32_t* v, uint32_t t) {
+    uint32_t predicted = t == 1 ? static_cast<uint32_t>(v[0])
+        : 2u * static_cast<uint32_t>(v[t - 1]) - static_cast<uint32_t>(v[t - 2]);
+    return static_cast<int32_t>(static_cast<uint32_t>(v[t]) - predicted);
+}
+
+// Output buffer that writes into a byte vector, so an in-memory capture is held once and handed
+// over by move. Only appends and tellp() are supported, which is all the writer does.
+class ByteVectorBuf : public std::streambuf {
+public:
+    explicit ByteVectorBuf(std::vector<uint8_t>& bytes) : bytes(bytes) {}
+protected:
+    int_type overflow(int_type c) override {
+        if (!traits_type::eq_int_type(c, traits_type::eof())) bytes.push_back(static_cast<uint8_t>(c));
+        return traits_type::not_eof(c);
+    }
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        bytes.insert(bytes.end(), reinterpret_cast<const uint8_t*>(s), reinterpret_cast<const uint8_t*>(s) + n);
+        return n;
+    }
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override {
+        if (off != 0 || dir != std::ios_base::cur || !(which & std::ios_base::out)) return pos_type(off_type(-1));
+        return pos_type(static_cast<off_type>(bytes.size()));
+    }
+private:
+    std::vector<uint8_t>& bytes;
+};
+
+TrajectoryWriter::TrajectoryWriter() : fragmentCount(0), frameCount(0), stopping(false) {}
+
+TrajectoryWriter::~TrajectoryWriter() {
+    close();
+}
+
+bool TrajectoryWriter::open(const std::string& path, const std::vector<FragmentSim>& fragments, const std::vector<Vertex>& triangles) {
+    close();
+    auto file = std::make_unique<std::ofstream>(path, std::ios::binary | std::ios::trunc);
+    if (!file->is_open()) {
+        logger.addLog(LogLevel::Error, "Failed to open trajectory file: " + path);
+        return false;
+    }
+    out = std::move(file);
+    begin(fragments, triangles);
+    return true;
+}
+
+bool TrajectoryWriter::openMemory(const std::vector<FragmentSim>& fragments, const std::vector<Vertex>& triangles) {
+    close();
+    memorySink = std::make_unique<ByteVectorBuf>(memoryBytes);
+    out = std::make_unique<std::ostream>(memorySink.get());
+    begin(fragments, triangles);
+    return true;
+}
+
+void TrajectoryWriter::begin(const std::vector<FragmentSim>& fragments, const std::vector<Vertex>& triangles) {
+    fragmentCount = static_cast<uint32_t>(fragments.size());
+    frameCount = 0;
+    index.clear();
+    memoryBytes.clear();
+    std::ostream& file = *out;
+    file.write(kHeaderMagic, sizeof(kHeaderMagic));
+    writeValue(file, kTrajectoryVersion);
+    writeValue(file, fragmentCount);
+    writeValue(file, kFramesPerChunk);
+    writeValue(file, kPositionScale);
+    writeValue(file, kAngleScale);
+    for (size_t i = 0; i < fragments.size(); ++i) {
+        file.write(reinterpret_cast<const char*>(&fragments[i].rotationAxis), sizeof(glm::vec3));
+        for (size_t k = 0; k < 3; ++k) {
+            const Vertex& v = triangles[i * 3 + k];
+            file.write(reinterpret_cast<const char*>(&v.Position), sizeof(glm::vec3));
+            file.write(reinterpret_cast<const char*>(&v.Normal), sizeof(glm::vec3));
+        }
+    }
+    current.times.clear();
+    current.values.clear();
+    current.values.reserve(static_cast<size_t>(fragmentCount) * 4 * kFramesPerChunk);
+    stopping = false;
+    worker = std::thread(&TrajectoryWriter::workerLoop, this);
+}
+
+void TrajectoryWriter::writeFrame(float time, const std::vector<FragmentSim>& fragments) {
+    if (!out || fragments.size() != fragmentCount) return;
+    // Hot path only quantizes; delta coding and packing happen on the worker
+    if (current.times.empty()) current.firstFrame = static_cast<uint32_t>(frameCount);
+    current.times.push_back(time);
+    for (const auto& frag : fragments) {
+        current.values.push_back(static_cast<int32_t>(std::lround(frag.position.x * kPositionScale)));
+        current.values.push_back(static_cast<int32_t>(std::lround(frag.position.y * kPositionScale)));
+        current.values.push_back(static_cast<int32_t>(std::lround(frag.position.z * kPositionScale)));
+        current.values.push_back(static_cast<int32_t>(std::lround(frag.rotationAngle * kAngleScale)));
+    }
+    frameCount++;
+    if (current.times.size() == kFramesPerChunk) submitCurrent();
+}
+
+void TrajectoryWriter::submitCurrent() {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    queue.push_back(std::move(current));
+    if (!freeChunks.empty()) {
+        current = std::move(freeChunks.back());
+        freeChunks.pop_back();
+    }
+    else {
+        current = RawChunk();
+        current.values.reserve(static_cast<size_t>(fragmentCount) * 4 * kFramesPerChunk);
+    }
+    current.times.clear();
+    current.values.clear();
+    queueChanged.notify_one();
+}
+
+void TrajectoryWriter::encodeChunk(const RawChunk& chunk, std::vector<uint8_t>& out) const {
+    uint32_t frames = static_cast<uint32_t>(chunk.times.size());
+    out.clear();
+    appendValue(out, frames);
+    for (float t : chunk.times) appendValue(out, t);
+    std::vector<int32_t> series(frames);
+    std::vector<uint32_t> residuals(frames);
+    for (uint32_t f = 0; f < fragmentCount; ++f) {
+        for (uint32_t c = 0; c < 4; ++c) {
+            for (uint32_t t = 0; t < frames; ++t)
+                series[t] = chunk.values[(static_cast<size_t>(t) * fragmentCount + f) * 4 + c];
+            appendVarint(out, zigzag(series[0]));
+            uint32_t maxResidual = 0;
+            for (uint32_t t = 1; t < frames; ++t) {
+                residuals[t] = zigzag(predictionResidual(series.data(), t));
+                maxResidual |= residuals[t];
+            }
+            uint8_t width = 0;
+            while (width < 32 && (maxResidual >> width)) width++;
+            out.push_back(width);
+            if (width == 0) continue;
+            uint64_t bits = 0;
+            int bitCount = 0;
+            for (uint32_t t = 1; t < frames; ++t) {
+                bits |= static_cast<uint64_t>(residuals[t]) << bitCount;
+                bitCount += width;
+                while (bitCount >= 8) {
+                    out.push_back(static_cast<uint8_t>(bits));
+                    bits >>= 8;
+                    bitCount -= 8;
+                }
+            }
+            if (bitCount > 0) out.push_back(static_cast<uint8_t>(bits));
+        }
+    }
+}
+
+void TrajectoryWriter::workerLoop() {
+    std::vector<uint8_t> encoded;
+    for (;;) {
+        RawChunk chunk;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueChanged.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty()) return;
+            chunk = std::move(queue.front());
+            queue.pop_front();
+        }
+        encodeChunk(chunk, encoded);
+        IndexEntry entry;
+        entry.offset = static_cast<uint64_t>(out->tellp());
+        entry.firstFrame = chunk.firstFrame;
+        entry.frameCount = static_cast<uint32_t>(chunk.times.size());
+        out->write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+        index.push_back(entry);
+        std::lock_guard<std::mutex> lock(queueMutex);
+        freeChunks.push_back(std::move(chunk));
+    }
+}
+
+bool TrajectoryWriter::close() {
+    if (!out) return false;
+    if (!current.times.empty()) submitCurrent();
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopping = true;
+    }
+    queueChanged.notify_one();
+    if (worker.joinable()) worker.join();
+    // Worker has drained the queue; the index is ours again
+    std::ostream& file = *out;
+    uint64_t indexOffset = static_cast<uint64_t>(file.tellp());
+    for (const auto& entry : index) {
+        writeValue(file, entry.offset);
+        writeValue(file, entry.firstFrame);
+        writeValue(file, entry.frameCount);
+    }
+    writeValue(file, static_cast<uint32_t>(index.size()));
+    writeValue(file, indexOffset);
+    file.write(kFooterMagic, sizeof(kFooterMagic));
+    bool ok = static_cast<bool>(file);
+    out.reset();
+    memorySink.reset();
+    return ok;
+}
+
+std::vector<uint8_t> TrajectoryWriter::takeMemory() {
+    std::vector<uint8_t> bytes = std::move(memoryBytes);
+    memoryBytes.clear();
+    return bytes;
+}
+
+TrajectoryReader::~TrajectoryReader() {
+    close();
+}
+
+void TrajectoryReader::close() {
+#ifdef _WIN32
+    if (mapping) {
+        UnmapViewOfFile(data);
+        CloseHandle(static_cast<HANDLE>(mapping));
+        CloseHandle(static_cast<HANDLE>(mappingFile));
+    }
+#else
+    if (mapping) munmap(mapping, size);
+#endif
+    mapping = nullptr;
+    mappingFile = nullptr;
+    storage.clear();
+    storage.shrink_to_fit();
+    data = nullptr;
+    size = 0;
+    frameCount = 0;
+    fragmentCount = 0;
+    cachedChunk = -1;
+}
+
+bool TrajectoryReader::openMapped(const std::string& path) {
+    close();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file != INVALID_HANDLE_VALUE) {
+        LARGE_INTEGER fileSize;
+        HANDLE map = GetFileSizeEx(file, &fileSize) ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+        const void* view = map ? MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        if (view) {
+            mappingFile = file;
+            mapping = map;
+            data = static_cast<const uint8_t*>(view);
+            size = static_cast<size_t>(fileSize.QuadPart);
+        }
+        else {
+            if (map) CloseHandle(map);
+            CloseHandle(file);
+        }
+    }
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd >= 0 && fstat(fd, &info) == 0 && info.st_size > 0) {
+        void* view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (view != MAP_FAILED) {
+            mapping = view;
+            data = static_cast<const uint8_t*>(view);
+            size = static_cast<size_t>(info.st_size);
+        }
+    }
+    // The mapping stays valid after the descriptor is closed
+    if (fd >= 0) ::close(fd);
+#endif
+    if (!data) {
+        logger.addLog(LogLevel::Error, "Failed to map trajectory: " + path);
+        return false;
+    }
+    if (!parse()) {
+        logger.addLog(LogLevel::Error, "Invalid trajectory file: " + path);
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool TrajectoryReader::openMemory(std::vector<uint8_t> bytes) {
+    close();
+    storage = std::move(bytes);
+    data = storage.data();
+    size = storage.size();
+    if (!parse()) {
+        logger.addLog(LogLevel::Error, "Invalid in-memory trajectory.");
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool TrajectoryReader::open(const std::string& path) {
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in.is_open()) {
+        logger.addLog(LogLevel::Error, "Failed to open trajectory: " + path);
+        return false;
+    }
+    std::vector<uint8_t> bytes(static_cast<size_t>(in.tellg()));
+    in.seekg(0);
+    in.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
+    return openMemory(std::move(bytes));
+}
+
+bool TrajectoryReader::parse() {
+    cachedChunk = -1;
+    if (size < sizeof(kHeaderMagic) + kFooterSize || memcmp(data, kHeaderMagic, 4) != 0) return false;
+    ByteCursor header{ data + 4, data + size };
+    uint32_t version = header.read<uint32_t>();
+    fragmentCount = header.read<uint32_t>();
+    uint32_t framesPerChunk = header.read<uint32_t>();
+    positionScale = header.read<float>();
+    angleScale = header.read<float>();
+    if (!header.ok || version != kTrajectoryVersion || framesPerChunk != TrajectoryWriter::kFramesPerChunk) return false;
+    // Counts are untrusted: they have to fit in the file before anything is sized by them
+    const uint64_t fragmentBytes = sizeof(glm::vec3) * 7;   // rotation axis, 3 x (position, normal)
+    if (static_cast<uint64_t>(fragmentCount) * fragmentBytes > static_cast<uint64_t>(header.end - header.p)) return false;
+    rotationAxes.resize(fragmentCount);
+    triangles.resize(static_cast<size_t>(fragmentCount) * 3);
+    for (uint32_t f = 0; f < fragmentCount; ++f) {
+        rotationAxes[f] = header.read<glm::vec3>();
+        for (int v = 0; v < 3; ++v) {
+            triangles[f * 3 + v].Position = header.read<glm::vec3>();
+            triangles[f * 3 + v].Normal = header.read<glm::vec3>();
+        }
+    }
+    ByteCursor footer{ data + size - kFooterSize, data + size };
+    uint32_t chunkCount = footer.read<uint32_t>();
+    uint64_t indexOffset = footer.read<uint64_t>();
+    if (!footer.ok || memcmp(footer.p, kFooterMagic, 4) != 0 || indexOffset > size - kFooterSize) return false;
+    const uint64_t entryBytes = sizeof(uint64_t) + 2 * sizeof(uint32_t);
+    if (static_cast<uint64_t>(chunkCount) * entryBytes > size - kFooterSize - indexOffset) return false;
+    ByteCursor cursor{ data + indexOffset, data + size - kFooterSize };
+    index.resize(chunkCount);
+    frameCount = 0;
+    const uint32_t framesPerFullChunk = TrajectoryWriter::kFramesPerChunk;
+    for (uint32_t i = 0; i < chunkCount; ++i) {
+        IndexEntry& entry = index[i];
+        entry.offset = cursor.read<uint64_t>();
+        entry.firstFrame = cursor.read<uint32_t>();
+        entry.frameCount = cursor.read<uint32_t>();
+        if (entry.offset >= indexOffset) return false;
+        // findChunk() and readFrame() rely on this layout: full chunks back to back, the last one 1..32
+        bool last = i + 1 == chunkCount;
+        if (static_cast<uint64_t>(entry.firstFrame) != static_cast<uint64_t>(i) * framesPerFullChunk
+            || (last ? entry.frameCount == 0 || entry.frameCount > framesPerFullChunk : entry.frameCount != framesPerFullChunk))
+            return false;
+        frameCount += entry.frameCount;
+    }
+    return cursor.ok;
+}
+
+int TrajectoryReader::findChunk(size_t frame) const {
+    if (frame >= frameCount) return -1;
+    // Every chunk but the last holds exactly kFramesPerChunk frames, so the keyframe is found in O(1)
+    return static_cast<int>(frame / TrajectoryWriter::kFramesPerChunk);
+}
+
+bool TrajectoryReader::decodeChunk(int chunk) {
+    if (chunk == cachedChunk) return true;
+    const IndexEntry& entry = index[chunk];
+    ByteCursor cursor{ data + entry.offset, data + size };
+    uint32_t frames = cursor.read<uint32_t>();
+    if (!cursor.ok || frames != entry.frameCount) return false;
+    // The cache is decoded in place; until this chunk is complete it holds neither
+    cachedChunk = -1;
+    cachedTimes.resize(frames);
+    for (auto& t : cachedTimes) t = cursor.read<float>();
+    cachedValues.resize(static_cast<size_t>(fragmentCount) * 4 * frames);
+    for (size_t stream = 0; stream < static_cast<size_t>(fragmentCount) * 4; ++stream) {
+        int32_t* v = &cachedValues[stream * frames];
+        v[0] = unzigzag(cursor.readVarint());
+        uint8_t width = cursor.read<uint8_t>();
+        if (!cursor.ok || width > 32) return false;
+        uint64_t bits = 0;
+        int bitCount = 0;
+        uint64_t mask = width == 32 ? 0xffffffffull : ((1ull << width) - 1);
+        for (uint32_t t = 1; t < frames; ++t) {
+            while (bitCount < width) {
+                bits |= static_cast<uint64_t>(cursor.read<uint8_t>()) << bitCount;
+                bitCount += 8;
+            }
+            uint32_t residual = static_cast<uint32_t>(bits & mask);
+            bits >>= width;
+            bitCount -= width;
+            uint32_t predicted = t == 1 ? static_cast<uint32_t>(v[0])
+                : 2u * static_cast<uint32_t>(v[t - 1]) - static_cast<uint32_t>(v[t - 2]);
+            v[t] = static_cast<int32_t>(predicted + static_cast<uint32_t>(unzigzag(residual)));
+        }
+        if (!cursor.ok) return false;
+    }
+    cachedChunk = chunk;
+    return true;
+}
+
+bool TrajectoryReader::readFrame(size_t frame, std::vector<FragmentPose>& poses) {
+    int chunk = findChunk(frame);
+    if (chunk < 0 || !decodeChunk(chunk)) return false;
+    size_t frames = cachedTimes.size();
+    size_t t = frame - index[chunk].firstFrame;
+    poses.resize(fragmentCount);
+    for (size_t f = 0; f < fragmentCount; ++f) {
+        const int32_t* stream = &cachedValues[f * 4 * frames];
+        poses[f].position = glm::vec3(stream[t] / positionScale, stream[frames + t] / positionScale,
+            stream[2 * frames + t] / positionScale);
+        poses[f].rotationAngle = stream[3 * frames + t] / angleScale;
+    }
+    return true;
+}
+
+float TrajectoryReader::getFrameTime(size_t frame) {
+    int chunk = findChunk(frame);
+    if (chunk < 0 || !decodeChunk(chunk)) return 0.0f;
+    return cachedTimes[frame - index[chunk].firstFrame];
+}
@@ -0,0 +1,114 @@
+// Trajectory.h
+#pragma once
+#include "SimulationCore.h"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Per-frame fragment transform as stored in a trajectory (the rotation axis is constant per fragment)
+struct FragmentPose {
+    glm::vec3 position;
+    float rotationAngle;
+};
+
+// Streams fragment transforms to disk. Positions and angles are quantized to integers; each chunk
+// starts with a keyframe and stores second-order deltas bit-packed per fragment and component, so
+// settled fragments cost almost nothing. Encoding and file I/O run on a background thread.
+class TrajectoryWriter {
+public:
+    TrajectoryWriter();
+    ~TrajectoryWriter();
+    // triangles: the fragments' template geometry, 3 vertices per fragment
+    bool open(const std::string& path, const std::vector<FragmentSim>& fragments, const std::vector<Vertex>& triangles);
+    // Same format, kept in memory; takeMemory() hands the bytes over after close()
+    bool openMemory(const std::vector<FragmentSim>& fragments, const std::vector<Vertex>& triangles);
+    void writeFrame(float time, const std::vector<FragmentSim>& fragments);
+    bool close();
+    std::vector<uint8_t> takeMemory();
+    bool isOpen() const { return out != nullptr; }
+    size_t getFrameCount() const { return frameCount; }
+    static constexpr uint32_t kFramesPerChunk = 32;
+    static constexpr float kPositionScale = 1024.0f;    // ~1 mm
+    static constexpr float kAngleScale = 16.0f;         // 1/16 degree
+private:
+    struct RawChunk {
+        uint32_t firstFrame;
+        std::vector<float> times;
+        std::vector<int32_t> values;    // frame-major: frame * fragments * 4 + fragment * 4 + component
+    };
+    struct IndexEntry {
+        uint64_t offset;
+        uint32_t firstFrame;
+        uint32_t frameCount;
+    };
+    std::unique_ptr<std::ostream> out;
+    std::unique_ptr<std::streambuf> memorySink;     // appends straight to memoryBytes
+    std::vector<uint8_t> memoryBytes;
+    uint32_t fragmentCount;
+    size_t frameCount;
+    RawChunk current;
+    std::vector<IndexEntry> index;
+    std::thread worker;
+    std::mutex queueMutex;
+    std::condition_variable queueChanged;
+    std::deque<RawChunk> queue;
+    std::vector<RawChunk> freeChunks;   // recycled so steady-state capture does not allocate
+    bool stopping;
+    void begin(const std::vector<FragmentSim>& fragments, const std::vector<Vertex>& triangles);
+    void submitCurrent();
+    void workerLoop();
+    void encodeChunk(const RawChunk& chunk, std::vector<uint8_t>& out) const;
+};
+
+// Random access to a trajectory: the chunk index finds the keyframe at or before a frame and
+// only that chunk is decoded. The most recently decoded chunk is cached.
+class TrajectoryReader {
+public:
+    TrajectoryReader() = default;
+    TrajectoryReader(const TrajectoryReader&) = delete;
+    TrajectoryReader& operator=(const TrajectoryReader&) = delete;
+    ~TrajectoryReader();
+    bool open(const std::string& path);
+    // Maps the file instead of reading it, so opening is instant and only touched chunks are paged in
+    bool openMapped(const std::string& path);
+    bool openMemory(std::vector<uint8_t> bytes);
+    void close();
+    bool isOpen() const { return data != nullptr; }
+    bool readFrame(size_t frame, std::vector<FragmentPose>& poses);
+    float getFrameTime(size_t frame);
+    size_t getFrameCount() const { return frameCount; }
+    size_t getFragmentCount() const { return fragmentCount; }
+    const std::vector<glm::vec3>& getRotationAxes() const { return rotationAxes; }
+    const std::vector<Vertex>& getTriangles() const { return triangles; }     // 3 per fragment
+private:
+    struct IndexEntry {
+        uint64_t offset;
+        uint32_t firstFrame;
+        uint32_t frameCount;
+    };
+    std::vector<uint8_t> storage;
+    void* mapping = nullptr;        // platform mapping handle / address when memory-mapped
+    void* mappingFile = nullptr;
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    uint32_t fragmentCount = 0;
+    size_t frameCount = 0;
+    float positionScale = 1.0f;
+    float angleScale = 1.0f;
+    std::vector<glm::vec3> rotationAxes;
+    std::vector<Vertex> triangles;
+    std::vector<IndexEntry> index;
+    int cachedChunk = -1;
+    std::vector<float> cachedTimes;
+    std::vector<int32_t> cachedValues;  // fragment-major: (fragment * 4 + component) * frames + frame
+    bool parse();
+    bool decodeChunk(int chunk);
+    int findChunk(size_t frame) const;
+};
@@ -11,12 +11,74 @@
 #include "backends/imgui_impl_opengl3.h"
 #include "Camera.h"
 #include "Logger.h"
+#include "GlState.h"
 #include "Shader.h"
 #include "Callbacks.h"
 #include "Globals.h"
+#include "CommandBuffer.h"
 #include "GlassSimulation.h"
+#include "GpuParticleSystem.h"
+#include "ParticleSystem.h"
+#include "SimulationRecording.h"
+#include "BatchSweep.h"
+#include <chrono>
+#include <sstream>
+#include <string>
+
+// --replay <file>: re-run a recording in the headless core and check it is bit-identical
+static int runHeadlessReplay(const std::string& path) {
+    Model model("assets/glass.obj", false);
+    SimulationRecording recording;
+    if (!recording.load(path)) return 1;
+    auto start = std::chrono::high_resolution_clock::now();
+    bool match = replayHeadless(recording, model.meshes);
+    auto end = std::chrono::high_resolution_clock::now();
+    logger.addLog(match ? LogLevel::Info : LogLevel::Error,
+        "Headless replay of " + path + " (" + std::to_string(recording.frameDts.size()) + " frames) took "
+        + std::to_string(std::chrono::duration<double, std::milli>(end - start).count()) + " ms, "
+        + (match ? "state matches." : "state diverged."));
+    return match ? 0 : 1;
+}
+
+// --batch <spec> [out.csv]: run a parameter sweep on every core without opening a window
+static int runBatchSweep(const std::string& args) {
+    std::istringstream parts(args);
+    std::string specPath, csvPath = "sweep.csv";
+    parts >> specPath >> csvPath;
+    SweepSpec spec;
+    if (!spec.load(specPath)) return 1;
+    Model model("assets/glass.obj", false);
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<SweepResult> results = runSweep(spec, model.meshes);
+    auto end = std::chrono::high_resolution_clock::now();
+    if (!writeSweepCsv(csvPath, results)) return 1;
+    logger.addLog("Sweep of " + std::to_string(results.size()) + " runs took "
+        + std::to_string(std::chrono::duration<double>(end - start).count()) + " s, results in " + csvPath);
+    return 0;
+}
 
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow) {
+    logger.startFileSink("simulation.log", 4 * 1024 * 1024, 3, true);
+    std::string args = lpCmdLine ? lpCmdLine : "";
+    if (args.rfind("--replay ", 0) == 0) {
+        // Explorer and shells quote paths with spaces; the command line arrives with the quotes
+        std::string path = args.substr(9);
+        if (path.size() >= 2 && path.front() == '"' && path.back() == '"') path = path.substr(1, path.size() - 2);
+        int result = runHeadlessReplay(path);
+        logger.stopFileSink();
+        return result;
+    }
+    if (args.rfind("--batch ", 0) == 0) {
+        int result = runBatchSweep(args.substr(8));
+        logger.stopFileSink();
+        return result;
+    }
+    // --check-commands: record, append and sort a known command set and compare its dump
+    if (args.rfind("--check-commands", 0) == 0) {
+        int result = CommandBuffer::selfCheck() ? 0 : 1;
+        logger.stopFileSink();
+        return result;
+    }
     if (!glfwInit()) return -1;
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
@@ -28,23 +90,25 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     }
     glfwMakeContextCurrent(window);
     gladLoadGL();
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glState.setEnabled(GL_DEPTH_TEST, true);
+    glState.setEnabled(GL_BLEND, true);
+    glState.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     unsigned int skyVAO, skyVBO;
     float skyVertices[] = { -1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f };
     glGenVertexArrays(1, &skyVAO);
     glGenBuffers(1, &skyVBO);
-    glBindVertexArray(skyVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, skyVBO);
+    glState.bindVertexArray(skyVAO);
+    glState.bindBuffer(GL_ARRAY_BUFFER, skyVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(skyVertices), skyVertices, GL_STATIC_DRAW);
     glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
 
+    shaderManager.enableHotReload("shaders");
     unsigned int skyShader = loadShader("shaders/sky.vert", "shaders/sky.frag");
     if (!skyShader) {
-        std::cerr << "Critical shader load error!\n";
+        logger.addLog(LogLevel::Error, "Critical shader load error!");
+        logger.stopFileSink();
         glfwTerminate();
         return -1;
     }
@@ -62,48 +126,163 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
     GlassSimulation simulation;
+    ParticleSystem particles(1 << 17);
+    simulation.setParticleSystem(&particles);
+    GpuParticleSystem gpuParticles(1 << 20);
+    simulation.setGpuParticleSystem(&gpuParticles);
+    CommandBuffer frameCommands, particleCommands;
 
     while (!glfwWindowShouldClose(window)) {
+        TRACE_SCOPE("frame");
+        profiler.beginFrame();
         float currentFrame = glfwGetTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
-        processInput(window);
-        simulation.update(deltaTime);
+        {
+            PROFILE_SCOPE("processInput");
+            processInput(window);
+        }
+        {
+            PROFILE_SCOPE("simulation.update");
+            simulation.update(deltaTime);
+        }
+        {
+            PROFILE_SCOPE("particles.update");
+            particles.update(deltaTime);
+        }
+        {
+            PROFILE_SCOPE("gpuParticles.update");
+            gpuParticles.update(deltaTime);
+        }
+        {
+            PROFILE_SCOPE("shaders.update");
+            shaderManager.update();
+        }
         glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         glm::mat4 projection = camera.getProjectionMatrix(1280.0f / 720.0f);
         glm::mat4 view = camera.getViewMatrix();
 
-        glDisable(GL_DEPTH_TEST);
-        glUseProgram(skyShader);
-        glBindVertexArray(skyVAO);
-        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-        glEnable(GL_DEPTH_TEST);
-
-        simulation.render(view, projection);
+        {
+            PROFILE_SCOPE("record");
+            simulation.beginFrame();
+            frameCommands.clear();
+            particleCommands.clear();
+            // Particles pack their instances on their worker while the glasses are culled here
+            particles.startRecording(particleCommands, view, projection);
+            CommandBuffer::DrawDesc sky;
+            sky.program = skyShader;
+            sky.vertexArray = skyVAO;
+            sky.mode = GL_TRIANGLE_STRIP;
+            sky.count = 4;
+            sky.depthTest = false;
+            frameCommands.draw(RenderPass::Sky, sky);
+            simulation.recordCommands(frameCommands, view, projection);
+            particles.finishRecording();
+            frameCommands.append(particleCommands);
+            frameCommands.sort();
+        }
+        {
+            PROFILE_SCOPE("sky");
+            PROFILE_GPU("sky");
+            frameCommands.submit(RenderPass::Sky);
+        }
+        {
+            PROFILE_SCOPE("simulation.render");
+            PROFILE_GPU("simulation");
+            simulation.submit(frameCommands, view, projection);
+        }
+        {
+            PROFILE_SCOPE("particles.render");
+            PROFILE_GPU("particles");
+            frameCommands.submit(RenderPass::Particles);
+            // Transform feedback state never leaves the GPU, so this pool draws directly
+            gpuParticles.render(view, projection);
+        }
 
-        ImGui_ImplOpenGL3_NewFrame();
-        ImGui_ImplGlfw_NewFrame();
-        ImGui::NewFrame();
-        ImGui::Begin("Controls");
-        ImGui::SliderFloat("Fall Height", &simulation.fallHeight, 5.0f, 20.0f);
-        ImGui::SliderFloat("Impact Angle", &simulation.impactAngle, 20.0f, 80.0f);
-        if (ImGui::Button("Reset Simulation")) simulation.resetSimulation();
-        ImGui::End();
-        logger.draw("Application Log");
-        ImGui::Render();
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        {
+            PROFILE_SCOPE("ImGui");
+            ImGui_ImplOpenGL3_NewFrame();
+            ImGui_ImplGlfw_NewFrame();
+            ImGui::NewFrame();
+            ImGui::Begin("Controls");
+            ImGui::SliderFloat("Fall Height", &simulation.fallHeight, 5.0f, 20.0f);
+            ImGui::SliderFloat("Impact Angle", &simulation.impactAngle, 20.0f, 80.0f);
+            ImGui::SliderInt("Dust Particles", &simulation.dustCount, 0, simulation.gpuDust ? 1000000 : 100000);
+            ImGui::SameLine();
+            ImGui::Checkbox("GPU Dust", &simulation.gpuDust);
+            ImGui::SliderInt("Glasses", &simulation.glassCount, 1, 1024);
+            ImGui::SliderFloat("Glass Spacing", &simulation.glassSpacing, 0.5f, 5.0f);
+            ImGui::SliderFloat("Height Jitter", &simulation.heightJitter, 0.0f, 0.9f);
+            ImGui::Checkbox("Adaptive Fracture LOD", &simulation.adaptiveLod);
+            ImGui::SliderInt("Fragment Budget", &simulation.fragmentBudget, 1000, 2000000);
+            ImGui::SliderFloat("Min Fragment Pixels", &simulation.minFragmentPixels, 1.0f, 400.0f);
+            ImGui::Checkbox("Bake Settled Shards", &simulation.bakeSettled);
+            ImGui::Checkbox("Frustum Culling", &simulation.frustumCulling);
+            ImGui::SameLine();
+            ImGui::Checkbox("Occlusion Culling", &simulation.occlusionCulling);
+            ImGui::Checkbox("Order-Independent Transparency", &simulation.orderIndependent);
+            if (!simulation.orderIndependent) {
+                ImGui::SameLine();
+                ImGui::Checkbox("Sort by Depth", &simulation.depthSort);
+            }
+            ImGui::Text("Fragments drawn: %zu / %zu live", simulation.getDrawnFragmentCount(), simulation.getLiveFragmentCount());
+            ImGui::Text("Glasses: %zu, fragments: %zu / %d (%zu baked)", simulation.getGlassCount(), simulation.getFragmentCount(),
+                simulation.fragmentBudget, simulation.getBakedFragmentCount());
+            ImGui::Text("Live particles: %zu", particles.getLiveCount());
+            ImGui::Checkbox("Capture Trajectory", &simulation.captureTrajectory);
+            if (ImGui::Button("Reset Simulation")) {
+                simulation.resetSimulation();
+                particles.reset();
+                gpuParticles.reset();
+            }
+            if (!simulation.isRecording()) {
+                if (ImGui::Button("Record Run")) simulation.startRecording();
+            }
+            else if (ImGui::Button("Stop Recording")) {
+                simulation.stopRecording("run.rec");
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Replay")) simulation.startReplay("run.rec");
+            ImGui::SameLine();
+            if (ImGui::Button("Verify Headless")) simulation.verifyRecording("run.rec");
+            if (simulation.isReplaying()) ImGui::TextUnformatted("Replaying run.rec");
+            simulation.drawPlaybackControls();
+            if (ImGui::Button("Particle Submit Benchmark")) particles.benchmarkSubmit(view, projection);
+            ImGui::SameLine();
+            if (ImGui::Button("Depth Sort Benchmark")) simulation.benchmarkDepthSort();
+            if (ImGui::Button("Dump Trace")) tracer.dump("trace.json");
+            ImGui::SameLine();
+            if (ImGui::Button("Dump Commands")) frameCommands.dump("commands.txt");
+            ImGui::End();
+            logger.draw("Application Log");
+            profiler.draw("Profiler");
+            ImGui::Render();
+            PROFILE_GPU("ImGui");
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+            // The backend restores what it changes, but behind glState's back
+            glState.invalidate();
+        }
 
-        glfwSwapBuffers(window);
+        {
+            PROFILE_SCOPE("swap");
+            glfwSwapBuffers(window);
+        }
         glfwPollEvents();
+        glState.publishCounters();
+        profiler.endFrame();
     }
 
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
-    glDeleteVertexArrays(1, &skyVAO);
-    glDeleteBuffers(1, &skyVBO);
+    profiler.shutdown();
+    tracer.dump("trace.json");
+    logger.stopFileSink();
+    glState.deleteVertexArrays(1, &skyVAO);
+    glState.deleteBuffers(1, &skyVBO);
+    shaderManager.release();
     glfwTerminate();
     return 0;
 }
@@ -0,0 +1,4 @@
+// shaders/camera.glsl
+// Camera uniforms of every world-space shader, set per draw
+uniform mat4 view;
+uniform mat4 projection;
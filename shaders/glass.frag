@@ -1,8 +1,16 @@
 // shaders/glass.frag
 #version 330 core
+// Variant OIT writes into the weighted blended OIT targets (see OitRenderer.h) instead of
+// blending over the framebuffer
 in vec3 FragPos;
 in vec3 Normal;
+in float ViewDepth;
+#ifdef OIT
+layout (location = 0) out vec4 accum;
+layout (location = 1) out float weight;
+#else
 out vec4 FragColor;
+#endif
 uniform vec3 lightPos = vec3(10.0, 10.0, 10.0);
 uniform vec3 viewPos;
 void main() {
@@ -13,5 +21,15 @@ void main() {
     float diff = max(dot(norm, lightDir), 0.0);
     vec3 diffuse = diff * vec3(0.8, 0.9, 1.0);
     vec3 result = ambient + diffuse;
-    FragColor = vec4(result, 0.5);
+    float alpha = 0.5;
+#ifdef OIT
+    // View-depth weight from McGuire & Bavoil, bounded form: nearer layers dominate the
+    // average. It falls off from about 5 units out (3e3 at 5, ~270 at 20, ~0.5 at 100), so the
+    // scene's range is weighted; the clamp keeps a few dozen stacked shards in half-float range
+    float w = clamp(0.03 / (1e-5 + pow(ViewDepth / 200.0, 4.0)), 1e-2, 3e3);
+    accum = vec4(result * alpha * w, alpha);
+    weight = alpha * w;
+#else
+    FragColor = vec4(result, alpha);
+#endif
 }
@@ -1,14 +1,49 @@
 // shaders/glass.vert
 #version 330 core
+// Variants: INSTANCED places each instance with a rigid transform; TRIANGLE_BUFFER (with
+// INSTANCED) draws one triangle per instance from the texture buffer, two texels (position,
+// normal) per vertex, three vertices per fragment, no vertex attributes. Without INSTANCED the
+// vertices are already in world space (the baked shards).
+#include "camera.glsl"
+#ifdef TRIANGLE_BUFFER
+uniform samplerBuffer fragmentTriangles;
+#else
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#endif
+#ifdef INSTANCED
+layout (location = 2) in vec4 instanceRotation;     // unit quaternion (x, y, z, w)
+layout (location = 3) in vec3 instanceTranslation;
+#endif
+#ifdef TRIANGLE_BUFFER
+layout (location = 4) in uint instanceTriangle;
+#endif
 out vec3 FragPos;
 out vec3 Normal;
+out float ViewDepth;    // distance along the view axis, for the OIT weight
+#ifdef INSTANCED
+vec3 rotate(vec4 q, vec3 v) {
+    return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+#endif
 void main() {
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;
-    gl_Position = projection * view * vec4(FragPos, 1.0);
+#ifdef TRIANGLE_BUFFER
+    int texel = (int(instanceTriangle) * 3 + gl_VertexID) * 2;
+    vec3 position = texelFetch(fragmentTriangles, texel).xyz;
+    vec3 normal = texelFetch(fragmentTriangles, texel + 1).xyz;
+#else
+    vec3 position = aPos;
+    vec3 normal = aNormal;
+#endif
+#ifdef INSTANCED
+    // Rigid instances: the normal turns with the same rotation, no inverse needed
+    FragPos = rotate(instanceRotation, position) + instanceTranslation;
+    Normal = rotate(instanceRotation, normal);
+#else
+    FragPos = position;
+    Normal = normal;
+#endif
+    vec4 viewPosition = view * vec4(FragPos, 1.0);
+    ViewDepth = -viewPosition.z;
+    gl_Position = projection * viewPosition;
 }
@@ -0,0 +1,20 @@
+// shaders/hiz_reduce.frag
+#version 330 core
+// Each target texel keeps the farthest depth of the source texels it covers, so a sphere in
+// front of that value may be visible and one behind it is certainly hidden
+uniform sampler2D depthTexture;
+uniform ivec2 sourceSize;
+uniform ivec2 targetSize;
+layout (location = 0) out float maxDepth;
+void main() {
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    ivec2 lo = texel * sourceSize / targetSize;
+    ivec2 hi = min(((texel + 1) * sourceSize + targetSize - 1) / targetSize, sourceSize);
+    float depth = 0.0;
+    for (int y = lo.y; y < hi.y; ++y) {
+        for (int x = lo.x; x < hi.x; ++x) {
+            depth = max(depth, texelFetch(depthTexture, ivec2(x, y), 0).r);
+        }
+    }
+    maxDepth = depth;
+}
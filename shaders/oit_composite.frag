@@ -0,0 +1,15 @@
+// shaders/oit_composite.frag
+#version 330 core
+// Weighted average of the accumulated translucent layers, blended over the opaque scene with
+// SRC_ALPHA / ONE_MINUS_SRC_ALPHA: the background keeps the product of (1 - alpha)
+uniform sampler2D accumTexture;
+uniform sampler2D weightTexture;
+out vec4 FragColor;
+void main() {
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    vec4 accum = texelFetch(accumTexture, texel, 0);
+    float revealage = accum.a;
+    if (revealage >= 1.0) discard;
+    float weight = texelFetch(weightTexture, texel, 0).r;
+    FragColor = vec4(accum.rgb / max(weight, 1e-5), 1.0 - revealage);
+}
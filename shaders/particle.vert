@@ -1,10 +1,12 @@
 // shaders/particle.vert
 #version 330 core
 layout (location = 0) in vec2 aPos;
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+layout (location = 1) in vec4 aParticle; // xyz = position, w = remaining life
+#include "camera.glsl"
 void main() {
-    vec4 pos = model * vec4(aPos, 0.0, 1.0);
-    gl_Position = projection * view * pos;
+    // Camera right/up are the first two rows of the view rotation
+    vec3 right = vec3(view[0][0], view[1][0], view[2][0]);
+    vec3 up = vec3(view[0][1], view[1][1], view[2][1]);
+    vec3 pos = aParticle.xyz + right * aPos.x + up * aPos.y;
+    gl_Position = projection * view * vec4(pos, 1.0);
 }
@@ -0,0 +1,17 @@
+// shaders/particle_point.vert
+#version 330 core
+layout (location = 0) in vec3 aPosition;
+layout (location = 2) in float aLife;
+#include "camera.glsl"
+uniform float pointSize;
+uniform float viewportHeight;
+void main() {
+    if (aLife <= 0.0) {
+        // Dead slots are pushed outside the clip volume
+        gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+        gl_PointSize = 0.0;
+        return;
+    }
+    gl_Position = projection * view * vec4(aPosition, 1.0);
+    gl_PointSize = max(pointSize * projection[1][1] * viewportHeight * 0.5 / gl_Position.w, 1.0);
+}
@@ -0,0 +1,56 @@
+// shaders/particle_update.vert
+#version 330 core
+layout (location = 0) in vec3 inPosition;
+layout (location = 1) in vec3 inVelocity;
+layout (location = 2) in float inLife;
+out vec3 outPosition;
+out vec3 outVelocity;
+out float outLife;
+uniform float dt;
+uniform float gravity;
+uniform uint capacity;
+uniform uint spawnStart;
+uniform uint spawnCount;
+uniform uint seed;
+uniform vec3 spawnSites[64];    // GpuParticleSystem::kMaxSpawnSites
+uniform uint siteCount;
+uniform float impactAngle;
+uniform float lifetime;
+
+// Integer hash so every particle slot gets its own random stream without CPU input
+uint hash(uint x) {
+    x ^= x >> 16u;
+    x *= 0x7feb352du;
+    x ^= x >> 15u;
+    x *= 0x846ca68bu;
+    x ^= x >> 16u;
+    return x;
+}
+float random01(inout uint state) {
+    state = hash(state);
+    return float(state) / 4294967295.0;
+}
+
+void main() {
+    uint slot = uint(gl_VertexID);
+    uint rel = (slot + capacity - spawnStart) % capacity;
+    if (rel < spawnCount) {
+        // Same distribution as the CPU ParticleSystem::initialize
+        uint state = slot ^ (seed * 0x9e3779b9u);
+        float speed = random01(state) * 5.0;
+        float angle = radians(impactAngle + (random01(state) * 5.0 - 2.5));
+        outPosition = spawnSites[hash(state) % siteCount];
+        outVelocity = vec3(speed * cos(angle), speed * sin(angle), random01(state) * 5.0);
+        outLife = lifetime;
+    }
+    else if (inLife > 0.0) {
+        outLife = inLife - dt;
+        outVelocity = inVelocity - vec3(0.0, gravity * dt, 0.0);
+        outPosition = inPosition + outVelocity * dt;
+    }
+    else {
+        outPosition = inPosition;
+        outVelocity = inVelocity;
+        outLife = inLife;
+    }
+}